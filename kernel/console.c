@@ -84,6 +84,8 @@ consoleread(int user_dst, uint64 dst, int n)
   char cbuf;
 
   target = n;
+  if(user_dst)
+    uvmprefault(dst, n, 1);
   acquire(&cons.lock);
   while(n > 0){
     // wait until interrupt handler has put some
@@ -109,8 +111,17 @@ consoleread(int user_dst, uint64 dst, int n)
 
     // copy the input byte to the user-space buffer.
     cbuf = c;
-    if(either_copyout(user_dst, dst, &cbuf, 1) == -1)
-      break;
+    if(either_copyout(user_dst, dst, &cbuf, 1) == -1){
+      // paged out meanwhile: put c back and bring the
+      // page back in without the lock.
+      cons.r--;
+      release(&cons.lock);
+      c = uvmprefault(dst, 1, 1);
+      acquire(&cons.lock);
+      if(c < 0)
+        break;
+      continue;
+    }
 
     dst++;
     --n;
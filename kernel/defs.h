@@ -5,6 +5,10 @@ struct inode;
 struct pipe;
 struct proc;
 struct page;
+struct segment;
+struct zpoolstat;
+struct kmemstat;
+struct clock;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -25,6 +29,8 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execload(struct proc*, uint64, char*);
+struct segment* execseg(struct proc*, uint64);
 
 // file.c
 struct file*    filealloc(void);
@@ -59,6 +65,7 @@ int		        createSwapFile(struct proc* p);
 int	          	readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
 int		        writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
 int		        removeSwapFile(struct proc* p);
+int		        unlinkSwapFile(struct file* f, int id);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -69,6 +76,11 @@ void            ramdiskrw(struct buf*);
 void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
+void            krefinc(void *);
+void*           megaalloc(void);
+void            megafree(void *);
+int             krefcnt(void *);
+void            kmem_stat(struct kmemstat *);
 
 // log.c
 void            initlog(int, struct superblock*);
@@ -100,11 +112,13 @@ struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
 void            procinit(void);
+uint64          proc_asid(struct proc*);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(char*, void (*)(void));
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
@@ -165,6 +179,11 @@ void            uartputc_sync(int);
 int             uartgetc(void);
 
 // vm.c
+extern struct sleeplock swap_lock;
+void            frameinit(void);
+void            kswapdinit(void);
+void            kswapd(void);
+void            wake_kswapd(void);
 void            kvminit(void);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
@@ -173,12 +192,17 @@ pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
 uint64          uvmalloc(pagetable_t, uint64, uint64);
 uint64          uvmdealloc(pagetable_t, uint64, uint64);
-uint64          uvmdeallocnew(pagetable_t, uint64, uint64);
 int             uvmcopy(pagetable_t, pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmlazy(struct proc*, uint64, char*);
+int             uvmprefault(uint64, uint64, int);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+pte_t*          megapte(pagetable_t, uint64);
+int             megasplit(pagetable_t, uint64);
+void            tlbflush(struct proc*, uint64, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
@@ -193,29 +217,115 @@ void            plic_complete(int);
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+uint64          virtio_swap_init(void);
+void            virtio_swap_rw(uint64, uint64 *, int, int);
+void            virtio_swap_intr(void);
+
+// zpool.c
+void            zpoolinit(void);
+int             zpool_put(struct proc *, uint, char *);
+int             zpool_get(struct proc *, uint, char *);
+void            zpool_drop(struct proc *, uint);
+void            zpool_stat(struct zpoolstat *);
+
+// swap.c
+void            swapinit(void);
+int             rawswap(void);
+int             swapalloc(int);
+void            swapfree(uint);
+void            swapdup(uint);
+int             swapget(struct proc *);
+void            swaptake(struct proc *, uint);
+void            swapdiscard(struct proc *, uint);
+void            swapreset(struct proc *);
+int             swapcacheok(struct proc *);
+int             swapfull(struct proc *);
+int             swapfileget(struct proc *);
+int             swapfileput(struct proc *);
+int             swapwrite(struct proc *, char *, uint, uint);
+int             swapread(struct proc *, char *, uint, uint);
+void            swapwritev(uint, uint64 *, int);
+void            swapreadv(uint, uint64 *, int);
+
+// replace.c
+extern int      defpolicy;
+void            clock_insert(struct clock*, struct page*);
+void            clock_remove(struct clock*, struct page*);
+void            policy_seq(struct page*, int);
+void            ghost_forget(struct proc*);
+void            policy_init(struct page*);
+void            policy_evicted(struct page*);
+int             policy_aging(struct proc*);
+void            policy_age(struct page*, int);
+struct page*    select_page(struct proc*);
+struct page*    NFUA_page_selection(struct proc*);
+struct page*    LAPA_page_selection(struct proc*);
+struct page*    SCFIFO_page_selection(struct proc*);
+struct page*    WSCLOCK_page_selection(struct proc*);
+struct page*    CLOCKPRO_page_selection(struct proc*);
+struct page*    ARC_page_selection(struct proc*);
+int             one_bits_counter(uint);
+
+// pgstat.c
+void            pgstatinit(void);
+void            pgstat_clear(struct proc*);
+void            pgstat_fault(struct proc*, int);
+void            pgstat_in(struct proc*, int);
+void            pgstat_out(struct proc*, int, int);
+void            pgstat_lat(struct proc*, int, uint64);
+void            pgstat_lockfail(struct proc*);
+int             getpgstat(int, uint64);
+
+// trace.c
+extern int      tracing;
+void            traceinit(void);
+void            trace_event(int, int, uint64, int);
+int             settrace(int);
+int             readtrace(uint64, int);
+
+// reap.c
+void            reapinit(void);
+void            kreapd(void);
+int             reap_pagetable(pagetable_t, uint64);
+int             reap_swapfile(struct file *, int);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
 
 // Task 1
-void            copy_pages(struct proc*, struct page*, struct page*);
 void            init_page(struct proc*);
 int             copy_swap_file(struct proc*);
 
 int             handle_page_fault(void);
 int             is_user_access_disabled(pte_t*);
 int             is_paged_out(pte_t*);
-void            handle_page_out(uint64, pte_t*);
-void            free_one_page(void);
-struct page*    select_page(void);
-void            add_page_to_phys_mem(uint64);
+int             handle_page_out(uint64, pte_t*, int);
+void            ensure_free_frame(struct proc*);
+int             free_one_page(struct proc*);
+int             free_pages(struct proc*, int);
+void            set_policy(struct proc*, int);
+int             advice_of(struct proc*, uint64);
+int             madvise(uint64, uint64, int);
+int             is_locked(struct proc*, uint64);
+int             unlock_range(struct proc*, uint64, uint64);
+int             mlock(uint64, uint64);
+int             munlock(uint64, uint64);
+struct clock*   clock_of(struct proc*);
+int             can_evict(struct page*, struct proc*);
+struct page*    first_frame(struct proc*);
+struct page*    next_frame(struct page*);
+void            add_page_to_phys_mem(struct proc*, pagetable_t, uint64, uint64);
+void            add_all_pages_to_phys_mem(struct proc*);
+void            remove_page_from_phys_mem(pagetable_t, uint64, uint64);
+void            drop_swap_cache(struct proc*);
+void            drop_frames(struct proc*);
+void            forget_ghosts(struct proc*);
 int             check_if_write(pte_t*);
-struct page*    NFUA_page_selection(void);
-struct page*    LAPA_page_selection(void);
-struct page*    SCFIFO_page_selection(void);
-int             one_bits_counter(uint);
-void            NFUA_LAPA_handler(void);
+void            age_pages(struct proc*);
 int             getFreePagesAmount(void);
 int             getPageFaultAmount(void);
+int             setPolicy(int, int);
 int             getFreePagesAmountFromKalloc(void);
-void            remove_page_from_memo(pte_t*, uint, struct page*);
\ No newline at end of file
+void            remove_swap_page(pagetable_t, pte_t*);
+pte_t*          next_swap_page(pagetable_t, uint64*, uint64);
+void            free_swap_pages(struct proc*, pagetable_t, uint64);
\ No newline at end of file
@@ -6,8 +6,9 @@
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
-
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
 
 int
 exec(char *path, char **argv)
@@ -16,36 +17,13 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *execip = 0, *oldip;
   struct proghdr ph;
+  struct segment segs[NSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
-  //Task 1+2
-  #ifndef NONE
-    int backup_num_of_phys_pages = 0;
-    int backup_num_of_swap_pages = 0;
-    int backup_num_of_page_faults = 0;
-
-    struct page backup_phys_pages[MAX_PSYC_PAGES]; //physical pages array
-    memset(backup_phys_pages, 0, sizeof(struct page));
-
-    struct page backup_swap_pages[MAX_PSYC_PAGES]; //swap pages array (32-16)
-    memset(backup_swap_pages, 0, sizeof(struct page));
-
-    if(myproc()->pid > 2) {
-      backup_num_of_phys_pages = myproc()->num_of_phys_pages;
-      backup_num_of_swap_pages = myproc()->num_of_swap_pages;
-      backup_num_of_page_faults = myproc()->total_page_faults;
-
-      //deep copy of physical pages + swap pages to backup fields
-      copy_pages(myproc(),backup_phys_pages,myproc()->phys_pages);
-      copy_pages(myproc(),backup_swap_pages,myproc()->swap_pages);
-
-      init_page(myproc()); // allocate a new physical page
-    }
-  #endif
-
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -63,7 +41,8 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program's segments. Their pages are read in
+  // from the executable when the program first touches them.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -73,17 +52,22 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr < sz || ph.vaddr + ph.memsz >= TRAPFRAME)
       goto bad;
-    sz = sz1;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg == NSEG)
       goto bad;
+    segs[nseg].vaddr = ph.vaddr;
+    segs[nseg].filesz = ph.filesz;
+    segs[nseg].off = ph.off;
+    nseg++;
+    sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // keep a reference to the executable for paging it in.
+  iunlock(ip);
   end_op();
+  execip = ip;
   ip = 0;
 
   p = myproc();
@@ -133,35 +117,44 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
 
-  //Task 1
-  #ifndef NONE
-    if(p->swapFile != 0) { // check if swap file not empty
-      removeSwapFile(p);
-      createSwapFile(p);
-    }
-
-    if(p->pid > 2) {
-      for(int idx = 0; idx < MAX_PSYC_PAGES; idx++) {
-        // deep copy iff current page is used
-        if(p->phys_pages[idx].state == P_USED) { 
-          p->phys_pages[idx].table = pagetable;  
-        }
-
-        // deep copy iff current page is used
-        if(p->swap_pages[idx].state == P_USED) { 
-          p->swap_pages[idx].table = pagetable;  
-        }
-      }
-    }
-  #endif
-
   // Commit to the user image.
   oldpagetable = p->pagetable;
   p->pagetable = pagetable;
+  p->asid = 0; //Task 1 - the new page table gets an ASID of its own
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  oldip = p->execip;
+  p->execip = execip;
+  memmove(p->segs, segs, sizeof(segs));
+  p->nseg = nseg;
+  p->nadvice = 0;
+  p->nlocks = 0;
+  p->nlocked = 0;
+
+  //Task 1 - the old image's swap slots, frames and ghosts are dropped
+  //before its page table is freed, then the new image's pages get tracked
+  #ifndef NONE
+    if(p->pid > 2) {
+      acquiresleep(&swap_lock);
+      free_swap_pages(p, oldpagetable, oldsz);
+      drop_swap_cache(p);
+      drop_frames(p);
+      forget_ghosts(p);
+    }
+  #endif
   proc_freepagetable(oldpagetable, oldsz);
+  #ifndef NONE
+    if(p->pid > 2) {
+      add_all_pages_to_phys_mem(p);
+      releasesleep(&swap_lock);
+    }
+  #endif
+  if(oldip){
+    begin_op();
+    iput(oldip);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
@@ -172,44 +165,52 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
-  
-  // Task 1.2 - restore parameters if exec fails
-  #ifndef NONE
-    if(p->pid > 2) {
-      p->num_of_phys_pages = backup_num_of_phys_pages;
-      p->num_of_swap_pages = backup_num_of_swap_pages;
-      p->total_page_faults = backup_num_of_page_faults;
-      copy_pages(p, p->phys_pages, backup_phys_pages);
-      copy_pages(p, p->swap_pages, backup_swap_pages);
-    }
-  #endif
+  if(execip){
+    begin_op();
+    iput(execip);
+    end_op();
+  }
+
   return -1;
 }
 
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+// Fill the page at va of p from its executable, if va lies in the
+// file-backed part of one of its segments. mem must be zeroed.
+// Returns 0 on success, -1 if the file can't be read.
+int
+execload(struct proc *p, uint64 va, char *mem)
+{
+  struct segment *seg;
+  uint n;
+  int r = 0;
+
+  if((seg = execseg(p, va)) == 0)
+    return 0;
+  n = seg->vaddr + seg->filesz - va;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  // a read() or write() of the executable itself holds its lock,
+  // and maybe a buffer readi() would wait for. fileread() and
+  // filewrite() bring the pages in before they lock it.
+  if(holdingsleep(&p->execip->lock))
+    return -1;
+  ilock(p->execip);
+  if(readi(p->execip, 0, (uint64)mem, seg->off + (va - seg->vaddr), n) != n)
+    r = -1;
+  iunlock(p->execip);
+  return r;
+}
+
+// The segment of p whose file-backed part holds the page at va, or 0.
+struct segment*
+execseg(struct proc *p, uint64 va)
 {
-  uint i, n;
-  uint64 pa;
-
-  if((va % PGSIZE) != 0)
-    panic("loadseg: va must be page aligned");
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
+  struct segment *seg;
+
+  va = PGROUNDDOWN(va);
+  for(seg = p->segs; seg < &p->segs[p->nseg]; seg++){
+    if(va >= seg->vaddr && va < seg->vaddr + seg->filesz)
+      return seg;
   }
-  
   return 0;
 }
@@ -106,7 +106,7 @@ filestat(struct file *f, uint64 addr)
 int
 fileread(struct file *f, uint64 addr, int n)
 {
-  int r = 0;
+  int r = 0, i, n1;
 
   if(f->readable == 0)
     return -1;
@@ -118,10 +118,28 @@ fileread(struct file *f, uint64 addr, int n)
       return -1;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
-    ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
-      f->off += r;
-    iunlock(f->ip);
+    // the copy out runs under the inode lock, where a page of
+    // the buffer can't be faulted in (see uvmcopyaddr()): bring
+    // it in a page at a time first, and read the page again if
+    // it was paged out before the copy.
+    for(i = 0; i < n; i += r){
+      n1 = PGSIZE - (addr + i) % PGSIZE;
+      if(n1 > n - i)
+        n1 = n - i;
+      if(uvmprefault(addr + i, n1, 1) < 0)
+        return -1;
+      ilock(f->ip);
+      if((r = readi(f->ip, 1, addr + i, f->off, n1)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      if(r < 0)
+        r = 0;
+      else if(r < n1){
+        i += r;
+        break;
+      }
+    }
+    r = i;
   } else {
     panic("fileread");
   }
@@ -159,6 +177,10 @@ filewrite(struct file *f, uint64 addr, int n)
       if(n1 > max)
         n1 = max;
 
+      // see fileread(). writei() stops short where the copy
+      // found a page paged out again; go on from there.
+      if(uvmprefault(addr + i, n1, 0) < 0)
+        break;
       begin_op();
       ilock(f->ip);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
@@ -166,7 +188,7 @@ filewrite(struct file *f, uint64 addr, int n)
       iunlock(f->ip);
       end_op();
 
-      if(r != n1){
+      if(r < 0){
         // error from writei
         break;
       }
@@ -699,22 +699,29 @@ char* itoa(int i, char b[]){
 //remove swap file of proc p;
 int
 removeSwapFile(struct proc* p)
+{
+  if(0 == p->swapFile)
+  {
+    return -1;
+  }
+  return unlinkSwapFile(p->swapFile, p->swapid);
+}
+
+//close swap file f, /.swap<id>, and remove it
+int
+unlinkSwapFile(struct file* f, int id)
 {
   //path of proccess
   char path[DIGITS];
   memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
+  itoa(id, path+ 6);
 
   struct inode *ip, *dp;
   struct dirent de;
   char name[DIRSIZ];
   uint off;
 
-  if(0 == p->swapFile)
-  {
-    return -1;
-  }
-  fileclose(p->swapFile);
+  fileclose(f);
 
   begin_op();
   if((dp = nameiparent(path, name)) == 0)
@@ -777,6 +784,10 @@ createSwapFile(struct proc* p)
   begin_op();
   
   struct inode * in = create(path, T_FILE, 0, 0);
+  if(in == 0){
+    end_op();
+    return -1;
+  }
   iunlock(in);
   p->swapFile = filealloc();
   if (p->swapFile == 0)
@@ -787,15 +798,18 @@ createSwapFile(struct proc* p)
   p->swapFile->off = 0;
   p->swapFile->readable = O_WRONLY;
   p->swapFile->writable = O_RDWR;
+  p->swapid = p->pid;
     end_op();
 
     return 0;
 }
 
-//return as sys_write (-1 when error)
+//return as sys_write (-1 when error). the first write gets p its swap file.
 int
 writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
+  if(p->swapFile == 0 && swapfileget(p) < 0)
+    return -1;
   p->swapFile->off = placeOnFile;
   return kfilewrite(p->swapFile, (uint64)buffer, size);
 }
@@ -804,6 +818,8 @@ writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 int
 readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
+  if(p->swapFile == 0)
+    return -1;
   p->swapFile->off = placeOnFile;
   return kfileread(p->swapFile, (uint64)buffer,  size);
 }
\ No newline at end of file
@@ -1,14 +1,26 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+// The top NMEGA aligned 2MB blocks of memory are kept
+// whole for user megapages, and broken into pages only
+// when the pages run out.
+//
+// Each hart keeps a cache of free pages, so that most
+// kalloc() and kfree() calls take only its own lock.
+// A cache is refilled from kmem, and drained back to it,
+// KBATCH pages at a time. A hart that finds its cache
+// and kmem empty takes half of another hart's cache.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 
+#define KBATCH 32       // pages moved between a cache and kmem at a time
+
 void freerange(void *pa_start, void *pa_end);
 
 extern char end[]; // first address after kernel.
@@ -21,15 +33,44 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
-//  int total_num_of_free_pages;
+  struct run *megalist;   // free 2MB blocks
+  int nmega;
+  int total_num_of_free_pages; // pages in freelist, megalist and the caches, updated atomically
+  uint64 locks;           // acquisitions of lock
+  uint64 contended;       // of them that found it held
+  int refcnt[(PHYSTOP-KERNBASE)/PGSIZE]; // mappings of each page, for copy-on-write fork, updated atomically
 } kmem;
 
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;                  // pages in freelist
+  uint64 allocs;          // pages kalloc() took from it
+  uint64 steals;          // pages it took from other caches
+} kcache[NCPU];
+
+#define PA2REF(pa) kmem.refcnt[((uint64)(pa) - KERNBASE) / PGSIZE]
+
 void
 kinit()
 {
+  char *mega;
+  int i;
+
   initlock(&kmem.lock, "kmem");
-//  kmem.total_num_of_free_pages = 0;
-  freerange(end, (void*)PHYSTOP);
+  for(i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
+  kmem.total_num_of_free_pages = 0;
+  mega = (char*)MEGAROUNDDOWN(PHYSTOP - NMEGA*MEGASIZE);
+  if(mega < (char*)PGROUNDUP((uint64)end))
+    mega = (char*)PHYSTOP;
+  freerange(end, mega);
+  for(; mega + MEGASIZE <= (char*)PHYSTOP; mega += MEGASIZE){
+    ((struct run*)mega)->next = kmem.megalist;
+    kmem.megalist = (struct run*)mega;
+    kmem.nmega++;
+    kmem.total_num_of_free_pages += MEGASIZE / PGSIZE;
+  }
 }
 
 void
@@ -37,32 +78,155 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    PA2REF(p) = 1;
     kfree(p);
+  }
+}
+
+// Acquire kmem.lock, counting the times
+// another hart held it.
+static void
+kmemlock(void)
+{
+  int busy = kmem.lock.locked;
+
+  acquire(&kmem.lock);
+  kmem.locks++;
+  if(busy)
+    kmem.contended++;
+}
+
+// Move up to KBATCH pages from kmem to cache c,
+// breaking up a 2MB block if kmem has no pages.
+// c->lock must be held.
+static void
+kfill(struct kcache *c)
+{
+  struct run *r;
+  char *p;
+  int n;
+
+  kmemlock();
+  if(kmem.freelist == 0 && kmem.megalist){
+    // out of pages: break up a 2MB block
+    p = (char*)kmem.megalist;
+    kmem.megalist = kmem.megalist->next;
+    kmem.nmega--;
+    for(r = (struct run*)p; (char*)r < p + MEGASIZE; r = (struct run*)((char*)r + PGSIZE)){
+      r->next = kmem.freelist;
+      kmem.freelist = r;
+    }
+  }
+  for(n = 0; n < KBATCH && kmem.freelist; n++){
+    r = kmem.freelist;
+    kmem.freelist = r->next;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->n++;
+  }
+  release(&kmem.lock);
+}
+
+// Move KBATCH pages from cache c back to kmem.
+// c->lock must be held.
+static void
+kdrain(struct kcache *c)
+{
+  struct run *first, *last;
+  int n;
+
+  first = last = c->freelist;
+  for(n = 1; n < KBATCH; n++)
+    last = last->next;
+  c->freelist = last->next;
+  c->n -= KBATCH;
+
+  kmemlock();
+  last->next = kmem.freelist;
+  kmem.freelist = first;
+  release(&kmem.lock);
+}
+
+// Take half of the pages of another hart's cache, for
+// hart id whose own cache and kmem are empty. Returns one
+// of them and keeps the rest in id's cache, or 0 if every
+// cache is empty. Called with no cache lock held, so that
+// two harts stealing from each other can't deadlock.
+static struct run*
+ksteal(int id)
+{
+  struct kcache *c;
+  struct run *r, *last;
+  int i, n;
+
+  for(i = 1; i < NCPU; i++){
+    c = &kcache[(id + i) % NCPU];
+    acquire(&c->lock);
+    if(c->n == 0){
+      release(&c->lock);
+      continue;
+    }
+    r = last = c->freelist;
+    for(n = 1; n < (c->n + 1) / 2; n++)
+      last = last->next;
+    c->freelist = last->next;
+    c->n -= n;
+    release(&c->lock);
+
+    c = &kcache[id];
+    acquire(&c->lock);
+    if(r != last){
+      last->next = c->freelist;
+      c->freelist = r->next;
+      c->n += n - 1;
+    }
+    c->allocs++;
+    c->steals += n;
+    release(&c->lock);
+    return r;
+  }
+  return 0;
 }
 
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// A page shared copy-on-write is only freed when
+// its last reference goes away.
 void
 kfree(void *pa)
 {
+  struct kcache *c;
   struct run *r;
+  int ref;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  ref = __sync_sub_and_fetch(&PA2REF(pa), 1);
+  if(ref < 0)
+    panic("kfree: refcnt");
+  if(ref > 0)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
 
   r = (struct run*)pa;
-//  kmem.total_num_of_free_pages++;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->n++;
+  if(c->n > 2*KBATCH)
+    kdrain(c);
+  release(&c->lock);
+  pop_off();
+  __sync_fetch_and_add(&kmem.total_num_of_free_pages, 1);
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -71,32 +235,121 @@ kfree(void *pa)
 void *
 kalloc(void)
 {
+  struct kcache *c;
   struct run *r;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-//  kmem.total_num_of_free_pages--;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
+  acquire(&c->lock);
+  if(c->freelist == 0)
+    kfill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+    c->allocs++;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = ksteal(id);
+  pop_off();
 
-  if(r)
+  if(r){
+    __sync_fetch_and_sub(&kmem.total_num_of_free_pages, 1);
+    PA2REF(r) = 1;
     memset((char*)r, 5, PGSIZE); // fill with junk
+  }
   return (void*)r;
 }
 
+// Allocate an aligned 2MB block for a user megapage.
+// Its pages count as allocated one by one, so that
+// the megapage can later be split and its pages freed
+// with kfree(). Returns 0 if no block is left.
+void *
+megaalloc(void)
+{
+  struct run *r;
+  char *p;
+
+  acquire(&kmem.lock);
+  r = kmem.megalist;
+  if(r){
+    kmem.megalist = r->next;
+    kmem.nmega--;
+    __sync_fetch_and_sub(&kmem.total_num_of_free_pages, MEGASIZE / PGSIZE);
+    for(p = (char*)r; p < (char*)r + MEGASIZE; p += PGSIZE)
+      PA2REF(p) = 1;
+  }
+  release(&kmem.lock);
+  return (void*)r;
+}
+
+// Free a block megaalloc() returned, still whole.
+void
+megafree(void *pa)
+{
+  struct run *r = (struct run*)pa;
+  char *p;
+
+  if(((uint64)pa % MEGASIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("megafree");
+
+  acquire(&kmem.lock);
+  for(p = (char*)pa; p < (char*)pa + MEGASIZE; p += PGSIZE){
+    if(PA2REF(p) != 1)
+      panic("megafree: refcnt");
+    PA2REF(p) = 0;
+  }
+  r->next = kmem.megalist;
+  kmem.megalist = r;
+  kmem.nmega++;
+  __sync_fetch_and_add(&kmem.total_num_of_free_pages, MEGASIZE / PGSIZE);
+  release(&kmem.lock);
+}
+
+// add a reference to page pa, shared by
+// one more copy-on-write mapping.
+void
+krefinc(void *pa)
+{
+  if(__sync_fetch_and_add(&PA2REF(pa), 1) < 1)
+    panic("krefinc");
+}
+
+// number of references to page pa.
+int
+krefcnt(void *pa)
+{
+  return __atomic_load_n(&PA2REF(pa), __ATOMIC_SEQ_CST);
+}
+
+// number of free physical pages, used by the
+// GLOBAL_RECLAIM low watermark.
 int
 getFreePagesAmountFromKalloc(void)
 {
-//    if(kmem.lock.locked) {
-//        acquire(&kmem.lock);
-//    }
-//
-//    int num = kmem.total_num_of_free_pages;
-//
-//    if(kmem.lock.locked) {
-//        release(&kmem.lock);
-//    }
-//    return num;
-return 0;
+  return __atomic_load_n(&kmem.total_num_of_free_pages, __ATOMIC_SEQ_CST);
+}
+
+// the allocator's counters, summed over the harts.
+void
+kmem_stat(struct kmemstat *st)
+{
+  struct kcache *c;
+
+  memset(st, 0, sizeof(*st));
+  for(c = kcache; c < &kcache[NCPU]; c++){
+    acquire(&c->lock);
+    st->allocs += c->allocs;
+    st->steals += c->steals;
+    st->cached += c->n;
+    release(&c->lock);
+  }
+  acquire(&kmem.lock);
+  st->locks = kmem.locks;
+  st->contended = kmem.contended;
+  release(&kmem.lock);
 }
@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -135,6 +136,7 @@ begin_op(void)
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      myproc()->locksheld++;
       release(&log.lock);
       break;
     }
@@ -150,6 +152,7 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  myproc()->locksheld--;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
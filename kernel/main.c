@@ -17,6 +17,9 @@ main()
     printf("xv6 kernel is booting\n");
     printf("\n");
     kinit();         // physical page allocator
+    frameinit();     // frame table for page replacement
+    traceinit();     // page reference tracing
+    pgstatinit();    // paging statistics
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
@@ -28,7 +31,10 @@ main()
     iinit();         // inode cache
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
+    swapinit();      // raw swap area, if there is a swap disk
     userinit();      // first user process
+    kswapdinit();    // page-out daemon
+    reapinit();      // deferred exit cleanup
     __sync_synchronize();
     started = 1;
   } else {
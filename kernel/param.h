@@ -11,3 +11,17 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NSWAPSLOT    65536 // max pages in the raw swap area
+#define NSWAPFILE    4     // released swap files kept for reuse
+#define SWAPFILEKEEP 16    // max pages of a swap file kept for reuse
+#define NREAP        32    // exit cleanups waiting for kreapd
+#define NSEG         4     // max loadable segments per executable
+#define NADVICE      8     // madvise() ranges remembered per process
+#define NLOCKS       4     // mlock()ed ranges per process
+#define NMEGA        8     // 2MB megapages kalloc keeps whole for user heaps
+#define SWAPCLUSTER  4     // max pages per swap read-ahead or write-out (<= 6)
+#define ZPOOLSIZE    (256*1024) // bytes of memory for compressed swapped-out pages
+#define AGETICKS     1     // ticks between NFUA/LAPA aging passes over a running process
+#define WSWINDOW     10    // WSClock working-set window, in ticks
+#define NGHOST       256   // recently evicted pages CLOCK-Pro and ARC remember
+#define NTRACE       1024  // page trace records buffered for readTrace()
@@ -0,0 +1,163 @@
+// Paging statistics.
+//
+// Every process slot and the system as a whole count faults, pages
+// moved in and out of swap space, evictions by policy, and how long
+// swap I/O took, in log2 buckets of time CSR ticks. A process' counters
+// start over when its slot is reused. getPagingStats() reads them.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "policy.h"
+#include "pgstat.h"
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  struct pgstat sys;
+  struct pgstat proc[NPROC];  // by slot of proc[]
+} pgstats;
+
+void
+pgstatinit(void)
+{
+  initlock(&pgstats.lock, "pgstat");
+}
+
+// Start the counters of p over, for a new process.
+void
+pgstat_clear(struct proc *p)
+{
+  acquire(&pgstats.lock);
+  memset(&pgstats.proc[p - proc], 0, sizeof(struct pgstat));
+  release(&pgstats.lock);
+}
+
+// p took a page fault; major if it read swap space.
+void
+pgstat_fault(struct proc *p, int major)
+{
+  acquire(&pgstats.lock);
+  if(major){
+    pgstats.sys.majflt++;
+    pgstats.proc[p - proc].majflt++;
+  } else {
+    pgstats.sys.minflt++;
+    pgstats.proc[p - proc].minflt++;
+  }
+  release(&pgstats.lock);
+}
+
+static void
+count_in(struct pgstat *st, int io)
+{
+  st->swapins++;
+  if(io)
+    st->inbytes += PGSIZE;
+}
+
+// A page of p came back from swap space; io if it was read.
+void
+pgstat_in(struct proc *p, int io)
+{
+  acquire(&pgstats.lock);
+  count_in(&pgstats.sys, io);
+  count_in(&pgstats.proc[p - proc], io);
+  release(&pgstats.lock);
+}
+
+static void
+count_out(struct pgstat *st, int policy, int io)
+{
+  st->swapouts++;
+  st->evicted[policy]++;
+  if(io)
+    st->outbytes += PGSIZE;
+}
+
+// A page of p was paged out, chosen by policy; io if it is written.
+void
+pgstat_out(struct proc *p, int policy, int io)
+{
+  acquire(&pgstats.lock);
+  count_out(&pgstats.sys, policy, io);
+  count_out(&pgstats.proc[p - proc], policy, io);
+  release(&pgstats.lock);
+}
+
+// p waited t time ticks for a swap read or write.
+void
+pgstat_lat(struct proc *p, int write, uint64 t)
+{
+  int b;
+
+  for(b = 0; b < NLATBUCKET-1 && (t >> (b+1)) != 0; b++)
+    ;
+  acquire(&pgstats.lock);
+  if(write){
+    pgstats.sys.wlat[b]++;
+    pgstats.proc[p - proc].wlat[b]++;
+  } else {
+    pgstats.sys.rlat[b]++;
+    pgstats.proc[p - proc].rlat[b]++;
+  }
+  release(&pgstats.lock);
+}
+
+// p was refused an mlock() over its limit.
+void
+pgstat_lockfail(struct proc *p)
+{
+  acquire(&pgstats.lock);
+  pgstats.sys.lockfails++;
+  pgstats.proc[p - proc].lockfails++;
+  release(&pgstats.lock);
+}
+
+// Copy the counters of process pid, or of the system if pid
+// is 0, to user address addr. Returns 0, or -1 if there is
+// no such process.
+int
+getpgstat(int pid, uint64 addr)
+{
+  struct pgstat st;
+  struct proc *p;
+
+  if(pid == 0){
+    acquire(&pgstats.lock);
+    st = pgstats.sys;
+    release(&pgstats.lock);
+    st.resident = st.swapped = st.locked = 0;
+    for(p = proc; p < &proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->state != UNUSED)
+        st.locked += p->nlocked;
+      release(&p->lock);
+    }
+  } else {
+    for(p = proc; p < &proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->pid == pid && p->state != UNUSED)
+        break;
+      release(&p->lock);
+    }
+    if(p == &proc[NPROC])
+      return -1;
+    acquire(&pgstats.lock);
+    st = pgstats.proc[p - proc];
+    release(&pgstats.lock);
+    st.resident = p->num_of_phys_pages;
+    st.swapped = p->num_of_swap_pages;
+    st.locked = p->nlocked;
+    release(&p->lock);
+  }
+  st.nfree = getFreePagesAmountFromKalloc();
+  if(copyout(myproc()->pagetable, addr, (char*)&st, sizeof(st)) < 0)
+    return -1;
+  return 0;
+}
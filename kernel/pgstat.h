@@ -0,0 +1,20 @@
+// paging statistics, for getPagingStats(). needs policy.h.
+#define NLATBUCKET  24        // latency histogram buckets
+#define PGSTAT_HZ   10000000  // time CSR ticks per second (qemu virt)
+
+struct pgstat {
+  uint64 minflt;              // faults served without reading swap space
+  uint64 majflt;              // faults that read a page back from swap space
+  uint64 swapins;             // pages brought back in, zero pages included
+  uint64 swapouts;            // pages paged out, clean and zero pages included
+  uint64 inbytes;             // bytes read from swap space
+  uint64 outbytes;            // bytes written to swap space
+  uint64 evicted[NPOLICY];    // pages paged out, by the policy that chose them
+  uint64 rlat[NLATBUCKET];    // swap reads taking [2^i, 2^(i+1)) time ticks, bucket 0 from 0
+  uint64 wlat[NLATBUCKET];    // swap writes, the same
+  uint64 lockfails;           // mlock() calls refused over the limit
+  int resident;               // a process: its resident pages
+  int swapped;                // a process: its pages in swap space
+  int locked;                 // mlock()ed pages
+  int nfree;                  // free physical pages
+};
@@ -76,9 +76,10 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, r;
   struct proc *pr = myproc();
 
+  uvmprefault(addr, n, 0);
   acquire(&pi->lock);
   while(i < n){
     if(pi->readopen == 0 || pr->killed){
@@ -90,8 +91,15 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       sleep(&pi->nwrite, &pi->lock);
     } else {
       char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
+      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1){
+        // paged out meanwhile: bring it back in without the lock.
+        release(&pi->lock);
+        r = uvmprefault(addr + i, 1, 0);
+        acquire(&pi->lock);
+        if(r < 0)
+          break;
+        continue;
+      }
       pi->data[pi->nwrite++ % PIPESIZE] = ch;
       i++;
     }
@@ -105,10 +113,11 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, r;
   struct proc *pr = myproc();
   char ch;
 
+  uvmprefault(addr, n, 1);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
@@ -121,8 +130,18 @@ piperead(struct pipe *pi, uint64 addr, int n)
     if(pi->nread == pi->nwrite)
       break;
     ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-      break;
+    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1){
+      // paged out meanwhile: put ch back and bring the
+      // page back in without the lock.
+      pi->nread--;
+      release(&pi->lock);
+      r = uvmprefault(addr + i, 1, 1);
+      acquire(&pi->lock);
+      if(r < 0)
+        break;
+      i--;
+      continue;
+    }
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
@@ -0,0 +1,15 @@
+// page replacement policies, for setPolicy()
+#define POLICY_NFUA      0  // not frequently used, with aging
+#define POLICY_LAPA      1  // least accessed page, with aging
+#define POLICY_SCFIFO    2  // second chance FIFO
+#define POLICY_WSCLOCK   3  // working set clock, preferring clean pages
+#define POLICY_CLOCKPRO  4  // CLOCK-Pro: hot and cold pages by reuse distance
+#define POLICY_ARC       5  // adaptive replacement, on a clock (CAR)
+#define NPOLICY          6
+
+// advice for madvise()
+#define MADV_NORMAL      0  // no advice
+#define MADV_RANDOM      1  // accessed at random: no read-ahead
+#define MADV_SEQUENTIAL  2  // scanned once: evict behind the scan
+#define MADV_WILLNEED    3  // swap the range in now
+#define MADV_DONTNEED    4  // throw the range away
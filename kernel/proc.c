@@ -3,8 +3,11 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
 #include "defs.h"
+#include "policy.h"
+#include "trace.h"
 
 struct cpu cpus[NCPU];
 
@@ -20,6 +23,21 @@ static void freeproc(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
+// Task 1 - address-space identifiers tag the TLB entries of each
+// process, so that a trap or a switch between processes needn't
+// flush them. they are handed out in generations: a process takes
+// the next free one when it returns to user space without one of
+// the current generation, and when they run out a new generation
+// starts; each hart flushes its whole TLB once before it runs a
+// process of the new one. ASID 0 is the kernel's, and every
+// process's on harts without ASIDs.
+struct {
+  struct spinlock lock;
+  uint64 gen;                  // the current generation, above ASIDMASK
+  uint64 next;                 // the next free ASID of it
+  uint64 max;                  // the largest ASID the harts implement
+} asids;
+
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
 // memory model when using p->parent.
@@ -47,9 +65,21 @@ void
 procinit(void)
 {
   struct proc *p;
+  uint64 satp;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
+  initlock(&asids.lock, "asid");
+
+  // the ASID bits that stick in satp are those the harts implement.
+  satp = r_satp();
+  w_satp(satp | (ASIDMASK << 44));
+  asids.max = SATP_ASID(r_satp());
+  w_satp(satp);
+  sfence_vma();
+  asids.gen = ASIDMASK + 1;
+  asids.next = 1;
+
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
@@ -66,6 +96,42 @@ cpuid()
   return id;
 }
 
+// The ASID p returns to user space with on this hart, once the
+// TLB entries the hart may hold for it that went stale are flushed.
+// Interrupts must be disabled.
+uint64
+proc_asid(struct proc *p)
+{
+  struct cpu *c = mycpu();
+  uint64 me = 1L << cpuid();
+  int flush;
+
+  if(asids.max == 0)
+    return 0; // trampoline.S flushes the TLB instead
+
+  acquire(&asids.lock);
+  if((p->asid & ~ASIDMASK) != asids.gen){
+    if(asids.next > asids.max){
+      asids.gen += ASIDMASK + 1;
+      asids.next = 1;
+    }
+    p->asid = asids.gen | asids.next++;
+    p->tlbstale = 0; // no hart has used it in this generation
+  }
+  flush = c->asidgen != asids.gen;
+  c->asidgen = asids.gen;
+  release(&asids.lock);
+
+  if(flush){
+    sfence_vma();
+    __sync_fetch_and_and(&p->tlbstale, ~me);
+  } else if(p->tlbstale & me){
+    __sync_fetch_and_and(&p->tlbstale, ~me);
+    sfence_vma_asid(p->asid & ASIDMASK);
+  }
+  return p->asid & ASIDMASK;
+}
+
 // Return this CPU's cpu struct.
 // Interrupts must be disabled.
 struct cpu*
@@ -143,14 +209,7 @@ found:
   p->context.sp = p->kstack + PGSIZE;
 
   //Task 1
-  init_page(p); // initialize page for this process
-  #ifndef NONE
-    if(p->pid > 2) {
-      release(&p->lock);
-      createSwapFile(p);
-      acquire(&p->lock);
-    }
-  #endif
+  init_page(p); // initialize page for this process, its swap file comes with the first page-out
 
   return p;
 }
@@ -174,6 +233,8 @@ freeproc(struct proc *p)
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->asid = 0;
+  p->tlbstale = 0;
   p->state = UNUSED;
 }
 
@@ -258,23 +319,67 @@ userinit(void)
   release(&p->lock);
 }
 
+// Start a kernel thread that runs fn. It has no user memory
+// and never returns to user space. fn is entered holding
+// p->lock, like forkret(), and must release it. Its pid is 0,
+// which leaves the pids of init and the shell unchanged.
+void
+kthread(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  for(p = proc; p < &proc[NPROC]; p++) {
+    acquire(&p->lock);
+    if(p->state == UNUSED)
+      goto found;
+    release(&p->lock);
+  }
+  panic("kthread");
+
+found:
+  p->pid = 0;
+  init_page(p);
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)fn;
+  p->context.sp = p->kstack + PGSIZE;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
 {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
+  int paging = 0;
+
+  #ifndef NONE
+    paging = p->pid > 2;
+  #endif
+  if(paging)
+    acquiresleep(&swap_lock);
 
   sz = p->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    //only reserve the address space, pages are allocated on first touch
+    if(sz + n > TRAPFRAME) {
+      if(paging)
+        releasesleep(&swap_lock);
       return -1;
     }
+    sz += n;
   } else if(n < 0){
     sz = uvmdealloc(p->pagetable, sz, sz + n);
+    unlock_range(p, PGROUNDUP(sz), PGROUNDUP(p->sz));
   }
   p->sz = sz;
+
+  if(paging)
+    releasesleep(&swap_lock);
   return 0;
 }
 
@@ -299,6 +404,32 @@ fork(void)
     return -1;
   }
   np->sz = p->sz;
+  np->policy = p->policy; //Task 1 - the replacement policy is inherited, and kept across exec
+
+  //Task 1 - copy swapped pages from parent to child, and track the
+  //child's resident pages. np->lock is dropped for the swap I/O; np
+  //isn't runnable yet, so nothing else looks at it meanwhile.
+  #ifndef NONE
+    if(np->pid > 2) {
+      release(&np->lock);
+      acquiresleep(&swap_lock);
+      if(p->pid > 2) {
+        np->num_of_swap_pages = p->num_of_swap_pages; //uvmcopy() copied the paged-out PTEs
+        if(copy_swap_file(np) < 0) {
+          free_swap_pages(np, np->pagetable, np->sz);
+          releasesleep(&swap_lock);
+          swapfileput(np);
+          acquire(&np->lock);
+          freeproc(np);
+          release(&np->lock);
+          return -1;
+        }
+      }
+      add_all_pages_to_phys_mem(np);
+      releasesleep(&swap_lock);
+      acquire(&np->lock);
+    }
+  #endif
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -311,23 +442,19 @@ fork(void)
     if(p->ofile[i])
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
+  if(p->execip)
+    np->execip = idup(p->execip);
+  memmove(np->segs, p->segs, sizeof(p->segs));
+  np->nseg = p->nseg;
+  memmove(np->advice, p->advice, sizeof(p->advice));
+  np->nadvice = p->nadvice;
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
 
   release(&np->lock);
-    //Task 1 - copy pages from parent to child
-    #ifndef NONE
-    if(myproc()->pid > 2) {
-        np->num_of_phys_pages = 0;
-        np->num_of_swap_pages = myproc()->num_of_swap_pages;
-        np->total_page_faults = 0;
-        copy_pages(np, np->swap_pages, myproc()->swap_pages);
-        //TODO kerneltrap here
-        copy_swap_file(np);
-    }
-    #endif
+
   acquire(&wait_lock);
   np->parent = p;
 
@@ -377,19 +504,41 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->execip)
+    iput(p->execip);
   end_op();
   p->cwd = 0;
+  p->execip = 0;
+  p->nseg = 0;
+  trace_event(TR_EXIT, p->pid, 0, 0);
 
-  //Task 1 - reset process pages
-  init_page(p);
+  //Task 1 - release the swap space. swap_lock waits out an eviction
+  //that may still be writing one of our pages to it.
   #ifndef NONE
-    if(p != 0 && p->pid > 2) {
-      if(removeSwapFile(p) < 0) {
+    if(p->pid > 2) {
+      acquiresleep(&swap_lock);
+      free_swap_pages(p, p->pagetable, p->sz);
+      p->num_of_swap_pages = 0;
+      drop_swap_cache(p);
+      drop_frames(p);
+      forget_ghosts(p);
+      if(swapfileput(p) < 0) {
         panic("exit: unable to remove swap file");
       }
     }
   #endif
 
+  // The user page table is no longer used. kreapd frees it,
+  // so that wait() needn't. Under swap_lock, so that retrack()
+  // in vm.c never finds p's mappings after drop_frames().
+  if(reap_pagetable(p->pagetable, p->sz) < 0)
+    proc_freepagetable(p->pagetable, p->sz);
+  p->pagetable = 0;
+  #ifndef NONE
+    if(p->pid > 2)
+      releasesleep(&swap_lock);
+  #endif
+
   acquire(&wait_lock);
 
   // Give any children to init.
@@ -419,10 +568,15 @@ wait(uint64 addr)
   int havekids, pid;
   struct proc *p = myproc();
 
+  // the status is copied out under wait_lock.
+  if(addr != 0)
+    uvmprefault(addr, sizeof(int), 1);
+
   acquire(&wait_lock);
 
   for(;;){
     // Scan through table looking for exited children.
+  scan:
     havekids = 0;
     for(np = proc; np < &proc[NPROC]; np++){
       if(np->parent == p){
@@ -437,15 +591,13 @@ wait(uint64 addr)
                                   sizeof(np->xstate)) < 0) {
             release(&np->lock);
             release(&wait_lock);
-            return -1;
+            // paged out meanwhile: bring it back in and look again.
+            if(uvmprefault(addr, sizeof(int), 1) < 0)
+              return -1;
+            acquire(&wait_lock);
+            goto scan;
           }
           freeproc(np);
-          //Task 1 - reset process page
-          #ifndef NONE
-            if(p->pid > 2) {
-              init_page(p);
-            }
-          #endif
           release(&np->lock);
           release(&wait_lock);
           return pid;
@@ -492,12 +644,6 @@ scheduler(void)
         p->state = RUNNING;
         c->proc = p;
         swtch(&c->context, &p->context);
-        
-        #if NFUA
-          NFUA_LAPA_handler();
-        #elif LAPA
-          NFUA_LAPA_handler();
-        #endif
 
         // Process is done running for now.
         // It should have changed its p->state before coming back.
@@ -697,92 +843,84 @@ procdump(void)
     printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
-}
 
-//Task 1 - this function deep-copies the parent page arrays to his child
-void
-copy_pages(struct proc *np, struct page *child_arr, struct page *parent_arr)
-{
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    child_arr[i].state = parent_arr[i].state; //copy state to child
-    if(parent_arr[i].state == P_USED) { // copy only if the page is used for the parent process
-      child_arr[i].c_time = parent_arr[i].c_time;
-      child_arr[i].offset = parent_arr[i].offset;
-      child_arr[i].virtual_add = parent_arr[i].virtual_add;
-      child_arr[i].counter = parent_arr[i].counter;
-//      child_arr[i].table = parent_arr[i].table;
-    } else { // in this case the page isn't used for the parent process
-      child_arr[i].c_time = 0;
-      child_arr[i].offset = 0;
-      child_arr[i].virtual_add = 0;
-      child_arr[i].counter = 0;
-//      child_arr[i].table = 0;
-
-      #if LAPA
-        // when a page is created or loaded into RAM - reset it's counter to 0xFFFFFFFF
-        child_arr[i].counter = 0xFFFFFFFF;
-      #endif
-    }
-  }
+  struct zpoolstat st;
+  zpool_stat(&st);
+  printf("swap pool: %d stored %d rejected %d hits %d misses %d spilled",
+         (int)st.stores, (int)st.rejects, (int)st.hits, (int)st.misses, (int)st.spills);
+  if(st.outbytes)
+    printf(" ratio %d%%", (int)(st.inbytes * 100 / st.outbytes));
+  printf("\n");
+
+  struct kmemstat ks;
+  kmem_stat(&ks);
+  printf("kalloc: %d allocs %d stolen %d cached, kmem.lock %d taken %d contended\n",
+         (int)ks.allocs, (int)ks.steals, ks.cached, (int)ks.locks, (int)ks.contended);
 }
 
-//Task 1 - initializing a page for process proc
+//Task 1 - initializing a page for process proc.
+//its resident frames must already have left the frame table.
 void
 init_page(struct proc* proc)
 {
   proc->num_of_phys_pages = 0;
   proc->num_of_swap_pages = 0;
   proc->total_page_faults = 0;
-  
-  //init all pages array
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    //initialize physical page fields
-    proc->phys_pages[i].c_time = 0;
-    proc->phys_pages[i].virtual_add = 0;
-    proc->phys_pages[i].offset = 0;
-    proc->phys_pages[i].counter = 0;
-    proc->phys_pages[i].state = P_UNUSED;
-
-    //initialize swap page fields
-    proc->swap_pages[i].c_time = 0;
-    proc->swap_pages[i].virtual_add = 0;
-    proc->swap_pages[i].offset = 0;
-    proc->swap_pages[i].counter = 0;
-    proc->swap_pages[i].state = P_UNUSED;
-  }
-
-  #if LAPA
-    // when a page is created or loaded into RAM - reset it's counter to 0xFFFFFFFF
-    for(int j=0; j<MAX_PSYC_PAGES; j++) {
-      proc->phys_pages[j].counter = 0xFFFFFFFF;
-      proc->swap_pages[j].counter = 0xFFFFFFFF;
-    }
-  #endif
+  pgstat_clear(proc);
+  proc->frames = 0;
+  swapreset(proc);
+  proc->agetick = 0;
+  proc->policy = defpolicy;
+  proc->clock.hand = 0;
+  proc->clock.n = 0;
+  proc->clock.ncold = 0;
+  proc->clock.target = 0;
+  proc->clock.nseq = 0;
+  proc->nadvice = 0;
+  proc->nlocks = 0;
+  proc->nlocked = 0;
 }
 
-// this function will be called from fork in order to copy the swap files
-//static char buff[PGSIZE];
+// this function will be called from fork in order to copy the swap space.
+// the child's paged-out PTEs, copied from the parent's, name the slots;
+// only those are copied, and zero pages have none. with a raw
+// swap area parent and child share those slots instead, until one of them
+// pages the page in. swap_lock must be held.
 int
 copy_swap_file(struct proc* new_p)
 {
-//  memset(buff, 0, PGSIZE); // initialize the buffer
-  for(int i=0; i < MAX_PSYC_PAGES; i++) {
-      char* buff;
-      if((buff = kalloc())==0){
-          panic("unable to kalloc for buffer");
-      }
-    if(readFromSwapFile(myproc(), buff, i*PGSIZE, PGSIZE) < 0) {
+  pte_t *pte;
+  uint64 va;
+  uint off;
+  char* buff = 0;
+
+  for(va = 0; (pte = next_swap_page(new_p->pagetable, &va, new_p->sz)) != 0; va += PGSIZE) {
+    if(*pte & PTE_Z)
+      continue;
+    off = PTE2SWAP(*pte);
+    if(rawswap()) {
+      swapdup(off);
+      continue;
+    }
+    swaptake(new_p, off);
+
+    if(buff == 0 && (buff = kalloc()) == 0)
+      return -1;
+    if(swapread(myproc(), buff, off, PGSIZE) < 0) {
       //unable to read from swap file
+      kfree(buff);
       return -1;
     }
 
-    if(writeToSwapFile(new_p, buff, i*PGSIZE, PGSIZE) < 0) {
+    if(swapwrite(new_p, buff, off, PGSIZE) < 0) {
       //unable to write to swap file
+      kfree(buff);
       return -1;
     }
+  }
 
+  if(buff)
     kfree(buff);
-  }
   return 1; //success
 }
 
@@ -796,4 +934,51 @@ int
 getPageFaultAmount(void)
 {
     return myproc()->total_page_faults;
-}
\ No newline at end of file
+}
+
+//Task 1 - set the page replacement policy of process pid, or of every
+//process and the ones the kernel creates if pid is 0. a policy of -1
+//only asks. under GLOBAL_RECLAIM all frames share one clock, and the
+//metadata of each frame must be what the policy sweeping it expects,
+//so only the system-wide policy can be set. returns the policy before,
+//or -1 if there is no such process or it can't have its own policy.
+int
+setPolicy(int pid, int policy)
+{
+  struct proc *p;
+  int old = -1;
+
+  if(policy < -1 || policy >= NPOLICY)
+    return -1;
+  #ifdef GLOBAL_RECLAIM
+    if(pid != 0 && policy >= 0)
+      return -1;
+  #endif
+
+  if(pid == 0) {
+    old = defpolicy;
+    if(policy < 0)
+      return old;
+    defpolicy = policy;
+    for(p = proc; p < &proc[NPROC]; p++) {
+      acquire(&p->lock);
+      if(p->state != UNUSED)
+        set_policy(p, policy);
+      release(&p->lock);
+    }
+    return old;
+  }
+
+  for(p = proc; p < &proc[NPROC]; p++) {
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED) {
+      old = p->policy;
+      if(policy >= 0)
+        set_policy(p, policy);
+      release(&p->lock);
+      return old;
+    }
+    release(&p->lock);
+  }
+  return -1;
+}
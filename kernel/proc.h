@@ -1,5 +1,8 @@
 #define MAX_PSYC_PAGES 16
-#define MAX_TOTAL_PAGES 32
+#define MAX_LOCKED_PAGES (MAX_PSYC_PAGES / 2) // pages a process may mlock()
+#define MIN_WATERMARK 16   // free frames below which a faulting process evicts itself
+#define LOW_WATERMARK 64   // free frames below which kswapd is woken
+#define HIGH_WATERMARK 128 // free frames kswapd evicts up to
 
 // Saved registers for kernel context switches.
 struct context {
@@ -27,6 +30,7 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 asidgen;             // ASID generation the TLB was last flushed for
 };
 
 extern struct cpu cpus[NCPU];
@@ -87,13 +91,74 @@ enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 enum state { P_USED, P_UNUSED };
 
 struct page {
-  uint offset;            // page offset
+  struct proc *proc;      // owning process (frame table entries)
   uint64 virtual_add;      // virtual address
-  pagetable_t table;      // page table
+  pte_t *pte;             // frames: the PTE that maps it
+  struct page *next;      // owner's resident frames list
+  struct page *prev;
+  struct page *cnext;     // clock, in the order the frames came in
+  struct page *cprev;
+  uint offset;            // page offset
   uint counter;           // will be used for NFU policy + AGING
-  uint c_time;            // creation time for SCFIFO policy
-
+  uint lastuse;           // WSClock: ticks when last seen accessed
   enum state state;       // state of page
+  char hot;               // CLOCK-Pro hot page, ARC page in T2
+  char test;              // CLOCK-Pro: cold page in its test period
+  char ref;               // accessed bit a trace pass took from the PTE
+  char seq;               // frames: in a range madvise()d MADV_SEQUENTIAL
+  char locked;            // frames: in an mlock()ed range, never evicted
+  char cached;            // frames: an unmodified copy is still at offset in swap space
+};
+
+// the resident frames in FIFO order, a circle with the oldest at the
+// hand. the clock policies sweep it.
+struct clock {
+  struct page *hand;      // next frame to look at, 0 if none
+  int n;                  // frames on the clock
+  int ncold;              // of them not hot
+  int target;             // CLOCK-Pro: cold frames wanted. ARC: frames wanted in T1
+  int nseq;               // of them seq, evicted first
+};
+
+// counters of the compressed swap pool in zpool.c
+struct zpoolstat {
+  uint64 stores;          // pages kept compressed
+  uint64 rejects;         // pages that didn't compress well enough
+  uint64 hits;            // swap-ins served from the pool
+  uint64 misses;          // swap-ins that went to disk
+  uint64 spills;          // pages written out to make room
+  uint64 inbytes;         // bytes stored, before compression
+  uint64 outbytes;        // and after
+};
+
+// counters of the page allocator in kalloc.c
+struct kmemstat {
+  uint64 allocs;          // pages kalloc() handed out
+  uint64 steals;          // pages taken from other harts' caches
+  uint64 locks;           // acquisitions of the shared kmem.lock
+  uint64 contended;       // of them that found another hart holding it
+  int cached;             // free pages in the per-hart caches
+};
+
+// a loadable segment of the running executable. exec only records it,
+// its pages are read in from the file on first access.
+struct segment {
+  uint64 vaddr;           // page-aligned start address
+  uint64 filesz;          // bytes backed by the file, the rest is zero
+  uint off;               // offset of the segment in the file
+};
+
+// advice given with madvise() on a range of the address space.
+struct advice {
+  uint64 va;              // page-aligned start
+  uint64 end;             // and end
+  int advice;             // MADV_* in policy.h
+};
+
+// a range of the address space mlock() pinned.
+struct lockrange {
+  uint64 va;              // page-aligned start
+  uint64 end;             // and end
 };
 
 // Per-process state
@@ -120,13 +185,28 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  struct file *swapFile;
+  struct file *swapFile;       // created on the first page-out, see swapfileget()
+  int swapid;                  // swapFile is /.swap<swapid>
 
   //Task 1
   int num_of_phys_pages;      // # of physical pages
-  int num_of_swap_pages;      // # of swap pages
+  int num_of_swap_pages;      // # of swap pages, each recorded in its PTE
   int total_page_faults;      // # of page faults TODO:maybe uint
+  uint agetick;               // ticks at the last NFUA/LAPA aging pass
+  int policy;                 // page replacement policy, POLICY_* in policy.h
+
+  struct page *frames;        // resident frames, entries of the frame table in vm.c
+  struct clock clock;         // clock of the frames, unless GLOBAL_RECLAIM
 
-  struct page swap_pages[MAX_PSYC_PAGES]; // swap pages array for the process
-  struct page phys_pages[MAX_PSYC_PAGES]; // physical pages array for the process
+  struct inode *execip;       // executable the text and data are paged in from
+  struct segment segs[NSEG];  // its loadable segments
+  int nseg;
+  struct advice advice[NADVICE]; // madvise() ranges, the newest last
+  int nadvice;
+  struct lockrange locks[NLOCKS]; // mlock()ed ranges, apart and in no order
+  int nlocks;
+  int nlocked;                // pages in them
+  int locksheld;              // sleeplocks held and log transactions begun, see uvmcopyaddr()
+  uint64 asid;                // ASID generation and ASID, see proc_asid()
+  uint64 tlbstale;            // harts that must flush the ASID before running p
 };
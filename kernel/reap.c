@@ -0,0 +1,108 @@
+// Deferred cleanup of exited processes.
+//
+// An exiting process hands its page table, and its swap file when
+// the pool in swap.c won't keep it, to kreapd, a kernel thread, so
+// that neither exit() nor the parent's wait() waits for the pages,
+// page-table pages and file blocks to be freed. The work goes on a
+// ring of NREAP entries; when it is full the caller does the work
+// itself, as before. kreapd takes REAPBATCH entries at a time, so
+// reap.lock is never held for long.
+//
+// A page table handed over is no process' any more: its frames have
+// left the frame table (see drop_frames()), and its swap space was
+// released, so only memory is left to free.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define REAPBATCH 8       // entries taken off the ring at a time
+
+struct reapwork {
+  pagetable_t pagetable;  // page table to free, with sz bytes of user memory
+  uint64 sz;
+  struct file *swapfile;  // or swap file to remove, /.swap<swapid>
+  int swapid;
+};
+
+struct {
+  struct spinlock lock;
+  struct reapwork work[NREAP];
+  uint r;                 // read index
+  uint w;                 // write index
+  int running;            // kreapd is there to take work
+} reap;
+
+// Queue w for kreapd. Returns 0, or -1 if the ring is full.
+static int
+reapput(struct reapwork *w)
+{
+  acquire(&reap.lock);
+  if(!reap.running || reap.w - reap.r == NREAP){
+    release(&reap.lock);
+    return -1;
+  }
+  reap.work[reap.w++ % NREAP] = *w;
+  wakeup(&reap);
+  release(&reap.lock);
+  return 0;
+}
+
+// Have kreapd free pagetable and its sz bytes of user memory.
+// Returns 0, or -1 if the caller must free them itself.
+int
+reap_pagetable(pagetable_t pagetable, uint64 sz)
+{
+  struct reapwork w = { pagetable, sz, 0, 0 };
+
+  return reapput(&w);
+}
+
+// Have kreapd close and remove swap file f, /.swap<id>.
+// Returns 0, or -1 if the caller must remove it itself.
+int
+reap_swapfile(struct file *f, int id)
+{
+  struct reapwork w = { 0, 0, f, id };
+
+  return reapput(&w);
+}
+
+void
+kreapd(void)
+{
+  struct proc *p = myproc();
+  struct reapwork w[REAPBATCH];
+  int i, n;
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  for(;;){
+    acquire(&reap.lock);
+    while(reap.r == reap.w)
+      sleep(&reap, &reap.lock);
+    for(n = 0; n < REAPBATCH && reap.r != reap.w; n++)
+      w[n] = reap.work[reap.r++ % NREAP];
+    release(&reap.lock);
+
+    for(i = 0; i < n; i++){
+      if(w[i].pagetable)
+        proc_freepagetable(w[i].pagetable, w[i].sz);
+      if(w[i].swapfile && unlinkSwapFile(w[i].swapfile, w[i].swapid) < 0)
+        printf("kreapd: unable to remove /.swap%d\n", w[i].swapid);
+    }
+  }
+}
+
+void
+reapinit(void)
+{
+  initlock(&reap.lock, "reap");
+  kthread("kreapd", kreapd);
+  reap.running = 1;
+}
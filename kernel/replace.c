@@ -0,0 +1,541 @@
+// Page replacement policies.
+//
+// Every resident user page has a frame table entry (struct page, see
+// vm.c), on a clock in the order the frames came in, with a counter
+// for the aging policies. A policy sets those up when a frame comes
+// in, may remember frames it pages out, and picks victims. vm.c owns
+// the frame table and calls in here with its lock held; nothing here
+// sleeps, takes a lock or touches anything but the frames and the PTEs
+// mapping them, so pgsim builds this same file for the host and replays
+// page traces against it.
+//
+// The environment provides clock_of(), can_evict(), first_frame(),
+// next_frame(), tlbflush() and ticks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "policy.h"
+
+static void NFUA_init(struct page*);
+static void LAPA_init(struct page*);
+static void SCFIFO_init(struct page*);
+static void WSCLOCK_init(struct page*);
+static void CLOCKPRO_init(struct page*);
+static void CLOCKPRO_evicted(struct page*);
+static void ARC_init(struct page*);
+static void ARC_evicted(struct page*);
+
+// page replacement policies. every frame is on a clock and has a
+// counter whatever the policy of its owner; a policy sets them up
+// when the frame comes in and picks victims with them.
+struct policy {
+  char *name;
+  void (*init)(struct page*);             // the frame came in. ftable.lock is held
+  struct page* (*select)(struct proc*);   // a victim to make room for p. ftable.lock is held
+  void (*evicted)(struct page*);          // the frame is being paged out, or 0. ftable.lock is held
+  int aging;                              // age the counters on timer ticks
+};
+
+static struct policy policies[NPOLICY] = {
+[POLICY_NFUA]     { "nfua",     NFUA_init,     NFUA_page_selection,     0,                1 },
+[POLICY_LAPA]     { "lapa",     LAPA_init,     LAPA_page_selection,     0,                1 },
+[POLICY_SCFIFO]   { "scfifo",   SCFIFO_init,   SCFIFO_page_selection,   0,                0 },
+[POLICY_WSCLOCK]  { "wsclock",  WSCLOCK_init,  WSCLOCK_page_selection,  0,                0 },
+[POLICY_CLOCKPRO] { "clockpro", CLOCKPRO_init, CLOCKPRO_page_selection, CLOCKPRO_evicted, 0 },
+[POLICY_ARC]      { "arc",      ARC_init,      ARC_page_selection,      ARC_evicted,      0 },
+};
+
+// pages CLOCK-Pro and ARC paged out lately, by owner and address. a ring: the
+// oldest ghost makes room for a new one.
+#define G_TEST  1               // CLOCK-Pro cold page still in its test period
+#define G_B1    2               // ARC: evicted from T1
+#define G_B2    3               // ARC: evicted from T2
+
+static struct {
+  struct ghost {
+    struct proc *proc;
+    uint64 va;
+    struct clock *clock;        // where the page was
+    int kind;                   // G_*, 0 if the entry is free
+  } g[NGHOST];
+  int next;                     // the oldest entry, replaced next
+  int n[4];                     // entries of each kind
+} ghosts;
+
+// the policy of processes the kernel creates, and of every process
+// after setPolicy(0, ...). SELECTION picks it at build time.
+#if NFUA
+int defpolicy = POLICY_NFUA;
+#elif LAPA
+int defpolicy = POLICY_LAPA;
+#else
+int defpolicy = POLICY_SCFIFO;
+#endif
+
+//put pg on clock c just behind the hand, where the newest frame goes.
+void
+clock_insert(struct clock *c, struct page *pg)
+{
+  if(c->hand == 0) {
+    pg->cnext = pg->cprev = pg;
+    c->hand = pg;
+  } else {
+    pg->cnext = c->hand;
+    pg->cprev = c->hand->cprev;
+    pg->cprev->cnext = pg;
+    c->hand->cprev = pg;
+  }
+  c->n++;
+  pg->hot = 0;
+  pg->test = 0;
+  pg->ref = 0;
+  c->ncold++;
+  if(pg->seq)
+    c->nseq++;
+}
+
+void
+clock_remove(struct clock *c, struct page *pg)
+{
+  if(!pg->hot)
+    c->ncold--;
+  if(pg->seq)
+    c->nseq--;
+  if(--c->n == 0) {
+    c->hand = 0;
+  } else {
+    if(c->hand == pg)
+      c->hand = pg->cnext;
+    pg->cprev->cnext = pg->cnext;
+    pg->cnext->cprev = pg->cprev;
+  }
+  pg->cnext = pg->cprev = 0;
+}
+
+//frame pg is, or no longer is, in a range its owner scans once.
+void
+policy_seq(struct page *pg, int seq)
+{
+  struct clock *c = clock_of(pg->proc);
+
+  if(pg->seq == seq)
+    return;
+  c->nseq += seq ? 1 : -1;
+  pg->seq = seq;
+}
+
+//make pg hot or cold on its clock.
+static void
+set_hot(struct page *pg, int hot)
+{
+  struct clock *c = clock_of(pg->proc);
+
+  if(pg->hot == hot)
+    return;
+  c->ncold += hot ? -1 : 1;
+  pg->hot = hot;
+}
+
+//remember frame pg, which is being paged out.
+static void
+ghost_add(struct page *pg, int kind)
+{
+  struct ghost *g = &ghosts.g[ghosts.next];
+
+  if(g->kind) {
+    ghosts.n[g->kind]--;
+    //a CLOCK-Pro test period ran out without the page coming back: less room for cold pages
+    if(g->kind == G_TEST && g->clock->target > 1)
+      g->clock->target--;
+  }
+  g->proc = pg->proc;
+  g->va = pg->virtual_add;
+  g->clock = clock_of(pg->proc);
+  g->kind = kind;
+  ghosts.n[kind]++;
+  ghosts.next = (ghosts.next + 1) % NGHOST;
+}
+
+//was the page at va of p paged out lately? its ghost is forgotten.
+//returns the kind of the ghost, or 0.
+static int
+ghost_take(struct proc *p, uint64 va)
+{
+  struct ghost *g;
+  int kind;
+
+  for(g = ghosts.g; g < &ghosts.g[NGHOST]; g++) {
+    if(g->kind && g->proc == p && g->va == va) {
+      kind = g->kind;
+      ghosts.n[kind]--;
+      g->kind = 0;
+      return kind;
+    }
+  }
+  return 0;
+}
+
+//forget the pages paged out of p, whose image goes away.
+void
+ghost_forget(struct proc *p)
+{
+  struct ghost *g;
+
+  for(g = ghosts.g; g < &ghosts.g[NGHOST]; g++) {
+    if(g->kind && g->proc == p) {
+      ghosts.n[g->kind]--;
+      g->kind = 0;
+    }
+  }
+}
+
+//frame pg came in for its owner.
+void
+policy_init(struct page *pg)
+{
+  policies[pg->proc->policy].init(pg);
+}
+
+//frame pg is being paged out.
+void
+policy_evicted(struct page *pg)
+{
+  if(policies[pg->proc->policy].evicted)
+    policies[pg->proc->policy].evicted(pg);
+}
+
+//does p's policy want its counters aged?
+int
+policy_aging(struct proc *p)
+{
+  return policies[p->policy].aging;
+}
+
+//one aging step of frame pg: the counter shifts right, taking the
+//accessed bit as its MSB.
+void
+policy_age(struct page *pg, int accessed)
+{
+  pg->counter = pg->counter >> 1; //trim the LSB
+  if(accessed)
+    pg->counter = pg->counter | (1U << 31); //turn on the MSB
+}
+
+//was pg accessed since the last look? the accessed bit is cleared. a
+//trace pass may have taken the bit already and left it in pg->ref.
+static int
+test_accessed(struct page *pg)
+{
+  int accessed = (*pg->pte & PTE_A) || pg->ref;
+
+  *pg->pte = *pg->pte & ~PTE_A;
+  tlbflush(pg->proc, pg->virtual_add, 1);
+  pg->ref = 0;
+  return accessed;
+}
+
+//choose a victim with p's replacement policy. frames of a range
+//madvise()d MADV_SEQUENTIAL go first, the oldest first: the scan has
+//moved past them.
+struct page*
+select_page(struct proc *p)
+{
+  struct clock *c = clock_of(p);
+  struct page *pg;
+  int n;
+
+  if(c->nseq > 0) {
+    for(pg = c->hand, n = c->n; n > 0; pg = pg->cnext, n--) {
+      if(pg->seq && can_evict(pg, p))
+        return pg;
+    }
+  }
+  return policies[p->policy].select(p);
+}
+
+static void
+NFUA_init(struct page *pg)
+{
+  pg->counter = 0;
+}
+
+static void
+LAPA_init(struct page *pg)
+{
+  pg->counter = 0xFFFFFFFF;
+}
+
+static void
+SCFIFO_init(struct page *pg)
+{
+  //the clock order is all it needs
+}
+
+struct page*
+NFUA_page_selection(struct proc *p)
+{
+  struct page *pg, *min_pg = 0;
+  
+  // get the minimum counter of all candidate pages
+  for(pg = first_frame(p); pg != 0; pg = next_frame(pg)) {
+    if(can_evict(pg, p)) {
+      if(min_pg == 0 || pg->counter < min_pg->counter) {
+        min_pg = pg;
+      }
+    }
+  }
+
+  if(min_pg)
+    min_pg->counter = 0; //reset counter
+  return min_pg;
+}
+
+struct page*
+LAPA_page_selection(struct proc *p)
+{
+  struct page *pg, *min_pg = 0;
+  uint min_counter_val = 0xFFFFFFFF;
+  uint min_by_ones = 33;
+  uint val;
+  
+  // get the minimum counter of all candidate pages
+  for(pg = first_frame(p); pg != 0; pg = next_frame(pg)) {
+    if(can_evict(pg, p)) {
+      val = one_bits_counter(pg->counter);
+      if(val < min_by_ones) {
+        min_by_ones = val;
+        min_counter_val = pg->counter;
+        min_pg = pg;
+      } else if(val == min_by_ones) {
+        if(pg->counter < min_counter_val) {
+          min_counter_val = pg->counter;
+          min_pg = pg;
+        }
+      }
+    }
+  }
+
+  if(min_pg)
+    min_pg->counter = 0xFFFFFFFF; //reset counter
+  return min_pg;
+}
+
+//count the number of bits of "1" for the counter inserted. Necessary for LAPA page selection
+int
+one_bits_counter(uint counter) 
+{
+  uint new_counter = 0;
+  while(counter) {
+    new_counter += counter & 1; //if the LSB is 1 add to counter, otherwise - don't add
+    counter = counter >> 1; // trim the LSB
+  }
+
+  return new_counter;
+}
+
+struct page*
+SCFIFO_page_selection(struct proc *p)
+{
+  struct clock *c = clock_of(p);
+  struct page *pg;
+  int n;
+
+  //the hand stops at the oldest page not accessed since it last passed.
+  //two turns at most: the first may only clear access bits
+  for(n = 2 * c->n; n > 0; n--) {
+    pg = c->hand;
+    c->hand = pg->cnext; //the hand moves on, whatever happens to pg
+    if(!can_evict(pg, p))
+      continue;
+    if(test_accessed(pg)) //turns off the access bit: another chance next turn
+      continue;
+    return pg;
+  }
+  return 0;
+}
+
+static void
+WSCLOCK_init(struct page *pg)
+{
+  pg->lastuse = ticks;
+}
+
+//can pg go without a write? its copy in the swap cache is still good.
+static int
+is_clean(struct page *pg)
+{
+  return pg->cached && (*pg->pte & PTE_D) == 0;
+}
+
+//WSClock: the hand passes over pages accessed since it last came by and
+//pages used in the last WSWINDOW ticks, the working set. it stops at the
+//first page out of the working set that can go without a write. a dirty
+//one is taken only after a whole turn without a clean one, and the least
+//recently used page of the working set only if no page is out of it.
+struct page*
+WSCLOCK_page_selection(struct proc *p)
+{
+  struct clock *c = clock_of(p);
+  struct page *pg, *dirty = 0, *oldest = 0;
+  uint now = ticks;
+  int n;
+
+  for(n = 0; n < 2 * c->n; n++) {
+    if(n == c->n && (dirty || oldest))
+      break;
+    pg = c->hand;
+    c->hand = pg->cnext;
+    if(!can_evict(pg, p))
+      continue;
+    if(test_accessed(pg)) {
+      pg->lastuse = now;
+      continue;
+    }
+    if(now - pg->lastuse > WSWINDOW) {
+      if(is_clean(pg))
+        return pg;
+      if(dirty == 0)
+        dirty = pg;
+    } else if(oldest == 0 || pg->lastuse < oldest->lastuse) {
+      oldest = pg;
+    }
+  }
+  return dirty ? dirty : oldest;
+}
+
+//a page that comes back while its ghost is still in the test period was
+//reused sooner than the cold pages last: it comes in hot, and cold pages
+//get more room. any other page comes in cold, starting its test period.
+static void
+CLOCKPRO_init(struct page *pg)
+{
+  struct clock *c = clock_of(pg->proc);
+
+  if(c->target < 1)
+    c->target = 1;
+  if(ghost_take(pg->proc, pg->virtual_add) == G_TEST) {
+    if(c->target < c->n)
+      c->target++;
+    set_hot(pg, 1);
+    pg->test = 0;
+  } else {
+    set_hot(pg, 0);
+    pg->test = 1;
+  }
+}
+
+static void
+CLOCKPRO_evicted(struct page *pg)
+{
+  if(!pg->hot && pg->test)
+    ghost_add(pg, G_TEST); //the test period goes on while it is out
+}
+
+//CLOCK-Pro, with one hand doing the work of its three. a cold page is paged
+//out unless it was accessed since the hand last came by: then it turns hot
+//if it was in its test period, or starts one. a hot page not accessed turns
+//cold while there are fewer cold pages than the target. a sequential scan
+//only ever makes cold pages, so it can't push the hot ones out.
+struct page*
+CLOCKPRO_page_selection(struct proc *p)
+{
+  struct clock *c = clock_of(p);
+  struct page *pg, *any = 0;
+  int n, accessed;
+
+  for(n = 3 * c->n; n > 0; n--) {
+    pg = c->hand;
+    c->hand = pg->cnext;
+    if(!can_evict(pg, p))
+      continue;
+    if(any == 0)
+      any = pg;
+    accessed = test_accessed(pg);
+    if(pg->hot) {
+      if(!accessed && c->ncold < c->target) {
+        set_hot(pg, 0);
+        pg->test = 0;
+      }
+      continue;
+    }
+    if(accessed) {
+      if(pg->test) {
+        set_hot(pg, 1);
+        pg->test = 0;
+      } else {
+        pg->test = 1;
+      }
+      continue;
+    }
+    return pg;
+  }
+  return any;
+}
+
+//ARC's lists on a clock: cold pages are T1, hot ones T2. a page comes in to
+//T1, or to T2 if its ghost shows it was paged out lately. a ghost from T1
+//means T1 was too small, and its target grows by the ratio of B2 ghosts to
+//B1 ghosts; a ghost from T2 shrinks it the other way.
+static void
+ARC_init(struct page *pg)
+{
+  struct clock *c = clock_of(pg->proc);
+  int b1 = ghosts.n[G_B1], b2 = ghosts.n[G_B2];
+
+  switch(ghost_take(pg->proc, pg->virtual_add)) {
+  case G_B1:
+    c->target += b2 > b1 ? b2 / b1 : 1;
+    if(c->target > c->n)
+      c->target = c->n;
+    set_hot(pg, 1);
+    break;
+  case G_B2:
+    c->target -= b1 > b2 ? b1 / b2 : 1;
+    if(c->target < 0)
+      c->target = 0;
+    set_hot(pg, 1);
+    break;
+  default:
+    set_hot(pg, 0);
+  }
+}
+
+static void
+ARC_evicted(struct page *pg)
+{
+  ghost_add(pg, pg->hot ? G_B2 : G_B1);
+}
+
+//CAR: the victim comes from T1 while T1 holds at least its target, from
+//T2 otherwise. an accessed page of T1 moves to T2, and an accessed page of
+//T2 gets a second chance. pages seen once, like a scan, stay in T1.
+struct page*
+ARC_page_selection(struct proc *p)
+{
+  struct clock *c = clock_of(p);
+  struct page *pg, *any = 0;
+  int n, fromt1;
+
+  for(n = 3 * c->n; n > 0; n--) {
+    pg = c->hand;
+    c->hand = pg->cnext;
+    if(!can_evict(pg, p))
+      continue;
+    if(any == 0)
+      any = pg;
+    fromt1 = c->ncold >= (c->target > 1 ? c->target : 1);
+    if(pg->hot == fromt1) //not on the list the victim comes from
+      continue;
+    if(test_accessed(pg)) {
+      set_hot(pg, 1);
+      continue;
+    }
+    return pg;
+  }
+  return any;
+}
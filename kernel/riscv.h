@@ -184,7 +184,12 @@ w_mtvec(uint64 x)
 // use riscv's sv39 page table scheme.
 #define SATP_SV39 (8L << 60)
 
-#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+// the address-space identifier tags the TLB entries made with
+// a page table. 0 is the kernel's.
+#define ASIDMASK 0xFFFFL
+#define SATP_ASID(satp) (((satp) >> 44) & ASIDMASK)
+
+#define MAKE_SATP(pagetable, asid) (SATP_SV39 | ((uint64)(asid) << 44) | (((uint64)pagetable) >> 12))
 
 // supervisor address translation and protection;
 // holds the address of the page table.
@@ -319,6 +324,20 @@ sfence_vma()
   asm volatile("sfence.vma zero, zero");
 }
 
+// flush the TLB entries of asid for the page at va.
+static inline void
+sfence_vma_page(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid));
+}
+
+// flush all TLB entries of asid.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid));
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -326,14 +345,26 @@ sfence_vma()
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+#define MEGASIZE (1L << 21) // bytes per megapage, mapped by a leaf PTE at level 1
+#define MEGAROUNDDOWN(a) (((a)) & ~(MEGASIZE-1))
+
 #define PTE_V (1L << 0) // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
 #define PTE_A (1L << 6) // page access
+#define PTE_D (1L << 7) // page written since the bit was cleared
 // Task 1
-#define PTE_PG (1L << 10) // Paged out to secondary storage (1024) this flag will indicate if the page is paged-out
+#define PTE_PG (1L << 9) // Paged out to secondary storage. uses an RSW bit so it can't collide with the PPN
+#define PTE_COW (1L << 8) // Copy-on-write: shared read-only after fork, copied on the first write
+
+// a paged-out PTE, which the hardware ignores without PTE_V, holds
+// the swap offset of its page above the flags, or PTE_Z for a page
+// of zeros, which has none.
+#define PTE_Z (1L << 10)
+#define SWAP2PTE(off) ((((uint64)(off)) >> 12) << 11)
+#define PTE2SWAP(pte) ((uint)(((pte) >> 11) << 12))
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
@@ -342,6 +373,9 @@ sfence_vma()
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// a valid PTE with any of R, W, X maps memory; otherwise it points to the next level.
+#define PTE_LEAF(pte) ((pte) & (PTE_R|PTE_W|PTE_X))
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
@@ -41,6 +41,9 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor mode read the time CSR, to time swap I/O.
+  w_mcounteren(r_mcounteren() | 2);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
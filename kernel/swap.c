@@ -0,0 +1,354 @@
+// Raw swap area.
+//
+// When qemu is given a second disk, as it is unless make is run with
+// SWAPDISK=0, paged-out pages go there instead of to the per-process
+// swap files, which can't grow past MAXFILE blocks. The disk is split
+// into page-sized slots that map straight to sectors, so a page moves
+// in one disk request, with no log, bmap() or buffer cache on the way.
+//
+// A paged-out PTE keeps the byte offset of its page's slot, in the
+// swap area or in the process' swap file. swapread() and
+// swapwrite() hide which of the two is in use, and go through the
+// compressed pool in zpool.c first.
+//
+// A page that is swapped in keeps its swap space as a swap cache
+// while there is plenty left: if it is paged out again before it
+// is written to, the copy in swap space is still good and there is
+// nothing to write. swapcacheok() decides.
+//
+// Without a swap disk a process gets its swap file only when a page
+// of it first has to be written there, so most never have one. A
+// file released at exit goes to a pool with its blocks, for the next
+// process that needs one, unless the pool is full or the file is
+// large; then kreapd in reap.c removes it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+
+#define SLOTSECTORS (PGSIZE / 512)
+#define FILEPAGES   (MAXFILE*BSIZE / PGSIZE)  // pages a swap file can hold
+#define FILEWORDS   ((FILEPAGES + 63) / 64)
+
+extern struct proc proc[NPROC];
+
+struct {
+  struct spinlock lock;
+  int nslot;              // 0 if there is no swap disk
+  int nfree;              // slots no process refers to
+  int next;               // slot after the last run allocated
+  uchar ref[NSWAPSLOT];   // processes sharing the slot since fork
+} swaparea;
+
+// the offsets of each process' swap file in use, a bit per page,
+// and how many, by slot of proc[]. they change under swap_lock.
+struct {
+  uint64 offs[FILEWORDS];
+  int n;
+} swapmap[NPROC];
+
+struct {
+  struct spinlock lock;
+  struct file *file[NSWAPFILE];   // released swap files
+  int id[NSWAPFILE];              // their swapid
+  int n;
+} swapfiles;
+
+void
+swapinit(void)
+{
+  initlock(&swaparea.lock, "swaparea");
+  initlock(&swapfiles.lock, "swapfiles");
+  zpoolinit();
+  swaparea.nslot = virtio_swap_init() / SLOTSECTORS;
+  if(swaparea.nslot > NSWAPSLOT)
+    swaparea.nslot = NSWAPSLOT;
+  swaparea.nfree = swaparea.nslot;
+  if(swaparea.nslot > 0)
+    printf("swap disk: %d pages\n", swaparea.nslot);
+}
+
+// Is the raw swap area in use?
+int
+rawswap(void)
+{
+  return swaparea.nslot > 0;
+}
+
+// The first run of n free slots in [from, to), or -1.
+// swaparea.lock must be held.
+static int
+swapfind(int from, int to, int n)
+{
+  int i, j;
+
+  for(i = from; i + n <= to; i = j + 1){
+    for(j = i; j < i + n && swaparea.ref[j] == 0; j++)
+      ;
+    if(j == i + n)
+      return i;
+  }
+  return -1;
+}
+
+// Allocate n consecutive slots in the swap area. The search
+// starts after the last run, where the slots are likely free,
+// and wraps around. Returns the byte offset of the first, or
+// -1 if there is no such run of free slots.
+int
+swapalloc(int n)
+{
+  int i, j;
+
+  acquire(&swaparea.lock);
+  if(swaparea.nfree < n){
+    release(&swaparea.lock);
+    return -1;
+  }
+  if((i = swapfind(swaparea.next, swaparea.nslot, n)) < 0)
+    i = swapfind(0, swaparea.nslot, n);
+  if(i >= 0){
+    for(j = i; j < i + n; j++)
+      swaparea.ref[j] = 1;
+    swaparea.nfree -= n;
+    swaparea.next = i + n;
+  }
+  release(&swaparea.lock);
+  return i < 0 ? -1 : i * PGSIZE;
+}
+
+// Drop a reference to the slot at byte offset off of the swap
+// area. The slot is free once no process refers to it.
+void
+swapfree(uint off)
+{
+  uint slot = off / PGSIZE;
+  int last;
+
+  acquire(&swaparea.lock);
+  if(slot >= swaparea.nslot || swaparea.ref[slot] == 0)
+    panic("swapfree");
+  last = --swaparea.ref[slot] == 0;
+  if(last)
+    swaparea.nfree++;
+  release(&swaparea.lock);
+  if(last)
+    zpool_drop(0, off);
+}
+
+// Add a reference to the slot at byte offset off, for a child
+// that shares it with its parent until one of them pages it in.
+void
+swapdup(uint off)
+{
+  uint slot = off / PGSIZE;
+
+  acquire(&swaparea.lock);
+  if(slot >= swaparea.nslot || swaparea.ref[slot] == 0)
+    panic("swapdup");
+  swaparea.ref[slot]++;
+  release(&swaparea.lock);
+}
+
+// Allocate swap space for a page of p: a slot of the swap area, or
+// a free offset in p's swap file. Returns the offset, or -1.
+int
+swapget(struct proc *p)
+{
+  uint64 *w = swapmap[p - proc].offs;
+  int i;
+
+  if(rawswap())
+    return swapalloc(1);
+  for(i = 0; i < FILEPAGES; i++){
+    if((w[i / 64] & (1L << (i % 64))) == 0){
+      w[i / 64] |= 1L << (i % 64);
+      swapmap[p - proc].n++;
+      return i * PGSIZE;
+    }
+  }
+  return -1;
+}
+
+// Take offset off of p's swap file, for a page fork copies to it.
+void
+swaptake(struct proc *p, uint off)
+{
+  uint64 *w = swapmap[p - proc].offs;
+  uint i = off / PGSIZE;
+
+  if((w[i / 64] & (1L << (i % 64))) == 0){
+    w[i / 64] |= 1L << (i % 64);
+    swapmap[p - proc].n++;
+  }
+}
+
+// Release p's swap space at offset off, whose page was swapped in
+// or unmapped.
+void
+swapdiscard(struct proc *p, uint off)
+{
+  uint64 *w = swapmap[p - proc].offs;
+  uint i = off / PGSIZE;
+
+  if(rawswap()){
+    swapfree(off);
+  } else {
+    if(w[i / 64] & (1L << (i % 64))){
+      w[i / 64] &= ~(1L << (i % 64));
+      swapmap[p - proc].n--;
+    }
+    zpool_drop(p, off);
+  }
+}
+
+// Forget the offsets of p's swap file, for a new process.
+void
+swapreset(struct proc *p)
+{
+  memset(&swapmap[p - proc], 0, sizeof(swapmap[0]));
+}
+
+// Give p a swap file, one from the pool if there is any.
+// Returns 0, or -1 if no file can be created.
+int
+swapfileget(struct proc *p)
+{
+  acquire(&swapfiles.lock);
+  if(swapfiles.n > 0){
+    swapfiles.n--;
+    p->swapFile = swapfiles.file[swapfiles.n];
+    p->swapid = swapfiles.id[swapfiles.n];
+    release(&swapfiles.lock);
+    return 0;
+  }
+  release(&swapfiles.lock);
+  return createSwapFile(p);
+}
+
+// Release p's swap file, if it has one: to the pool, blocks and all,
+// or to kreapd to be removed. Returns 0, or -1 if it couldn't be removed.
+int
+swapfileput(struct proc *p)
+{
+  int r = 0;
+
+  if(p->swapFile == 0)
+    return 0;
+  acquire(&swapfiles.lock);
+  if(swapfiles.n < NSWAPFILE && p->swapFile->ip->size <= SWAPFILEKEEP*PGSIZE){
+    swapfiles.file[swapfiles.n] = p->swapFile;
+    swapfiles.id[swapfiles.n++] = p->swapid;
+    release(&swapfiles.lock);
+  } else {
+    release(&swapfiles.lock);
+    if(reap_swapfile(p->swapFile, p->swapid) < 0)
+      r = removeSwapFile(p);
+  }
+  p->swapFile = 0;
+  return r;
+}
+
+// May a page of p that is being swapped in keep its swap space as a
+// swap cache? Only while a quarter of the swap area, or of p's swap
+// file, is free.
+int
+swapcacheok(struct proc *p)
+{
+  int ok;
+
+  if(rawswap()){
+    acquire(&swaparea.lock);
+    ok = swaparea.nfree > swaparea.nslot / 4;
+    release(&swaparea.lock);
+    return ok;
+  }
+  return FILEPAGES - swapmap[p - proc].n > FILEPAGES / 4;
+}
+
+// Is p's swap file full? Slots of the raw swap area are taken
+// before victims are chosen, so it never is there.
+int
+swapfull(struct proc *p)
+{
+  return !rawswap() && swapmap[p - proc].n == FILEPAGES;
+}
+
+// Write a page at kernel address buf to offset off of p's swap space.
+// It is kept compressed in memory if the pool has room for it.
+// Returns size, or -1 on error, like writeToSwapFile().
+int
+swapwrite(struct proc *p, char *buf, uint off, uint size)
+{
+  uint64 pa = (uint64)buf;
+
+  if(size != PGSIZE || off % PGSIZE)
+    panic("swapwrite");
+  if(zpool_put(rawswap() ? 0 : p, off, buf) == 0)
+    return size;
+  if(!rawswap())
+    return writeToSwapFile(p, buf, off, size);
+  virtio_swap_rw(off / 512, &pa, 1, 1);
+  return size;
+}
+
+// Read a page from offset off of p's swap space to kernel address buf.
+// Returns size, or -1 on error, like readFromSwapFile().
+int
+swapread(struct proc *p, char *buf, uint off, uint size)
+{
+  uint64 pa = (uint64)buf;
+
+  if(size != PGSIZE || off % PGSIZE)
+    panic("swapread");
+  if(zpool_get(rawswap() ? 0 : p, off, buf) == 0)
+    return size;
+  if(!rawswap())
+    return readFromSwapFile(p, buf, off, size);
+  virtio_swap_rw(off / 512, &pa, 1, 0);
+  return size;
+}
+
+// Write the n pages at kernel addresses pa[] to consecutive
+// slots of the swap area starting at offset off. The pages the
+// pool can't keep go out with one request per run.
+void
+swapwritev(uint off, uint64 *pa, int n)
+{
+  int i, j;
+
+  if(!rawswap() || off % PGSIZE)
+    panic("swapwritev");
+  for(i = 0; i < n; i = j + 1){
+    for(j = i; j < n && zpool_put(0, off + j*PGSIZE, (char*)pa[j]) < 0; j++)
+      ;
+    // pages i..j-1 didn't fit in the pool, page j did.
+    if(j > i)
+      virtio_swap_rw((off + i*PGSIZE) / 512, &pa[i], j - i, 1);
+  }
+}
+
+// Read n consecutive slots starting at offset off into the pages
+// at kernel addresses pa[]. The pages the pool doesn't hold come
+// in with one request per run.
+void
+swapreadv(uint off, uint64 *pa, int n)
+{
+  int i, j;
+
+  if(!rawswap() || off % PGSIZE)
+    panic("swapreadv");
+  for(i = 0; i < n; i = j + 1){
+    for(j = i; j < n && zpool_get(0, off + j*PGSIZE, (char*)pa[j]) < 0; j++)
+      ;
+    if(j > i)
+      virtio_swap_rw((off + i*PGSIZE) / 512, &pa[i], j - i, 0);
+  }
+}
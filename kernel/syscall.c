@@ -106,6 +106,13 @@ extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_getFreePagesAmount(void);
 extern uint64 sys_getPageFaultAmount(void);
+extern uint64 sys_setPolicy(void);
+extern uint64 sys_setTrace(void);
+extern uint64 sys_readTrace(void);
+extern uint64 sys_getPagingStats(void);
+extern uint64 sys_madvise(void);
+extern uint64 sys_mlock(void);
+extern uint64 sys_munlock(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -131,6 +138,13 @@ static uint64 (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 [SYS_getFreePagesAmount]   sys_getFreePagesAmount,
 [SYS_getPageFaultAmount]   sys_getPageFaultAmount,
+[SYS_setPolicy]   sys_setPolicy,
+[SYS_setTrace]    sys_setTrace,
+[SYS_readTrace]   sys_readTrace,
+[SYS_getPagingStats] sys_getPagingStats,
+[SYS_madvise]     sys_madvise,
+[SYS_mlock]       sys_mlock,
+[SYS_munlock]     sys_munlock,
 };
 
 void
@@ -22,3 +22,10 @@
 #define SYS_close  21
 #define SYS_getFreePagesAmount  22
 #define SYS_getPageFaultAmount  23
+#define SYS_setPolicy  24
+#define SYS_setTrace   25
+#define SYS_readTrace  26
+#define SYS_getPagingStats  27
+#define SYS_madvise    28
+#define SYS_mlock      29
+#define SYS_munlock    30
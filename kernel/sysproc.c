@@ -107,3 +107,80 @@ sys_getPageFaultAmount(void)
 {
     return getPageFaultAmount();
 }
+
+uint64
+sys_setPolicy(void)
+{
+  int pid, policy;
+
+  if(argint(0, &pid) < 0 || argint(1, &policy) < 0)
+    return -1;
+  return setPolicy(pid, policy);
+}
+
+uint64
+sys_setTrace(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return settrace(on != 0);
+}
+
+uint64
+sys_readTrace(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return readtrace(addr, n);
+}
+
+uint64
+sys_getPagingStats(void)
+{
+  uint64 addr;
+  int pid;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return getpgstat(pid, addr);
+}
+
+uint64
+sys_madvise(void)
+{
+  uint64 addr;
+  int len, advice;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if(len < 0)
+    return -1;
+  return madvise(addr, len, advice);
+}
+
+uint64
+sys_mlock(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return mlock(addr, len);
+}
+
+uint64
+sys_munlock(void)
+{
+  uint64 addr;
+  int len;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &len) < 0 || len < 0)
+    return -1;
+  return munlock(addr, len);
+}
@@ -0,0 +1,97 @@
+// Page reference tracing.
+//
+// While tracing is on, the kernel records every page fault, and
+// every page the aging pass in vm.c finds accessed, in a ring that
+// readTrace() drains to user space. pgtrace prints the records, and
+// pgsim replays them against the policies in replace.c built for the
+// host. Records that find the ring full are counted and dropped.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+#include "trace.h"
+
+#define NCOPY 16          // records copied out at a time
+
+int tracing;
+
+struct {
+  struct spinlock lock;
+  struct trace rec[NTRACE];
+  uint r;                 // read index
+  uint w;                 // write index
+  int lost;               // records dropped since settrace()
+} tr;
+
+void
+traceinit(void)
+{
+  initlock(&tr.lock, "trace");
+}
+
+void
+trace_event(int type, int pid, uint64 va, int write)
+{
+  struct trace *t;
+
+  if(!tracing)
+    return;
+  acquire(&tr.lock);
+  if(tr.w - tr.r == NTRACE){
+    tr.lost++;
+    // an exit takes the place of the newest record, pgtrace waits for it.
+    if(type != TR_EXIT){
+      release(&tr.lock);
+      return;
+    }
+    tr.w--;
+  }
+  t = &tr.rec[tr.w++ % NTRACE];
+  t->tick = ticks;
+  t->pid = pid;
+  t->va = va;
+  t->type = type;
+  t->write = write;
+  release(&tr.lock);
+}
+
+// Turn tracing on or off. Returns the number of records
+// dropped since the last call.
+int
+settrace(int on)
+{
+  int lost;
+
+  acquire(&tr.lock);
+  tracing = on;
+  lost = tr.lost;
+  tr.lost = 0;
+  release(&tr.lock);
+  return lost;
+}
+
+// Move up to n records to user address addr.
+// Returns the number moved, or -1.
+int
+readtrace(uint64 addr, int n)
+{
+  struct trace buf[NCOPY];
+  int i, got;
+
+  for(got = 0; got < n; got += i){
+    acquire(&tr.lock);
+    for(i = 0; i < NCOPY && got + i < n && tr.r != tr.w; i++)
+      buf[i] = tr.rec[tr.r++ % NTRACE];
+    release(&tr.lock);
+    if(i == 0)
+      break;
+    if(copyout(myproc()->pagetable, addr + got*sizeof(struct trace),
+               (char*)buf, i*sizeof(struct trace)) < 0)
+      return -1;
+  }
+  return got;
+}
@@ -0,0 +1,13 @@
+// page reference trace records, read with readTrace()
+struct trace {
+  uint tick;              // ticks when recorded
+  int pid;
+  uint64 va;              // page
+  int type;               // TR_*
+  int write;              // store fault, or the page was dirty
+};
+
+#define TR_FAULT   1      // page fault on va
+#define TR_ACCESS  2      // va found accessed by a trace pass
+#define TR_EXIT    3      // the process exited
+#define TR_AGE     4      // a trace pass over the process ended
@@ -66,18 +66,13 @@ usertrap(void)
 
     syscall();
 
-#ifndef NONE
   } else if(r_scause() == 12 || r_scause() == 13 || r_scause() == 15){ //page fault received
-        printf("pagefault: unexpected scause %p pid=%d page=%d\n", r_scause(), p->pid, PGROUNDDOWN(r_stval())/PGSIZE);
-        printf("            stval=%p\n", r_stval());
-        if(myproc() != 0 && myproc()->pid > 2) {
-          int num = handle_page_fault();
-//          handle_page_fault();
-          if(num == 1) {
-            p->killed = 1; //page fault scenario in user-space
-          }
+        //copy-on-write and paged-out pages are handled, anything else kills p
+        if(handle_page_fault() == 1) {
+          printf("pagefault: unexpected scause %p pid=%d page=%d\n", r_scause(), p->pid, PGROUNDDOWN(r_stval())/PGSIZE);
+          printf("            stval=%p\n", r_stval());
+          p->killed = 1; //page fault scenario in user-space
         }
-#endif
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -90,8 +85,12 @@ usertrap(void)
     exit(-1);
 
   // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  if(which_dev == 2) {
+    #ifndef NONE
+      age_pages(p); //Task 1 - not from kerneltrap(), which may hold the frame table lock
+    #endif
     yield();
+  }
 
   usertrapret();
 }
@@ -132,7 +131,7 @@ usertrapret(void)
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP(p->pagetable, proc_asid(p));
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
@@ -202,6 +201,8 @@ devintr()
       uartintr();
     } else if(irq == VIRTIO0_IRQ){
       virtio_disk_intr();
+    } else if(irq == VIRTIO1_IRQ){
+      virtio_swap_intr();
     } else if(irq){
       printf("unexpected interrupt irq=%d\n", irq);
     }
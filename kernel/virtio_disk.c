@@ -5,6 +5,10 @@
 //
 // qemu ... -drive file=fs.img,if=none,format=raw,id=x0 -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 //
+// an optional second disk on virtio-mmio-bus.1 holds the raw
+// swap area (see swap.c). it takes whole-page requests straight
+// from kernel memory instead of struct bufs.
+//
 
 #include "types.h"
 #include "riscv.h"
@@ -17,10 +21,10 @@
 #include "buf.h"
 #include "virtio.h"
 
-// the address of virtio mmio register r.
-#define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
+// the address of virtio mmio register r of disk d.
+#define R(d, r) ((volatile uint32 *)((d)->base + (r)))
 
-static struct disk {
+struct disk {
   // the virtio driver and device mostly communicate through a set of
   // structures in RAM. pages[] allocates that memory. pages[] is a
   // global (instead of calls to kalloc()) because it must consist of
@@ -60,8 +64,9 @@ static struct disk {
   // track info about in-flight operations,
   // for use when completion interrupt arrives.
   // indexed by first descriptor index of chain.
+  // busy is cleared, and woken up, when the request is done.
   struct {
-    struct buf *b;
+    int *busy;
     char status;
   } info[NUM];
 
@@ -70,31 +75,40 @@ static struct disk {
   struct virtio_blk_req ops[NUM];
   
   struct spinlock vdisk_lock;
+
+  uint64 base;     // mmio registers
+  uint64 capacity; // in 512-byte sectors
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+} __attribute__ ((aligned (PGSIZE)));
 
-void
-virtio_disk_init(void)
+static struct disk disk;      // file system disk
+static struct disk swapdisk;  // raw swap area, if present
+
+// set up the virtio disk at mmio address base.
+// returns -1 if there is no disk there.
+static int
+disk_init(struct disk *d, uint64 base, char *name)
 {
   uint32 status = 0;
 
-  initlock(&disk.vdisk_lock, "virtio_disk");
+  initlock(&d->vdisk_lock, name);
+  d->base = base;
 
-  if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
-     *R(VIRTIO_MMIO_VERSION) != 1 ||
-     *R(VIRTIO_MMIO_DEVICE_ID) != 2 ||
-     *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
-    panic("could not find virtio disk");
+  if(*R(d, VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
+     *R(d, VIRTIO_MMIO_VERSION) != 1 ||
+     *R(d, VIRTIO_MMIO_DEVICE_ID) != 2 ||
+     *R(d, VIRTIO_MMIO_VENDOR_ID) != 0x554d4551){
+    return -1;
   }
   
   status |= VIRTIO_CONFIG_S_ACKNOWLEDGE;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   status |= VIRTIO_CONFIG_S_DRIVER;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // negotiate features
-  uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+  uint64 features = *R(d, VIRTIO_MMIO_DEVICE_FEATURES);
   features &= ~(1 << VIRTIO_BLK_F_RO);
   features &= ~(1 << VIRTIO_BLK_F_SCSI);
   features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
@@ -102,51 +116,75 @@ virtio_disk_init(void)
   features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
   features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
   features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-  *R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
+  *R(d, VIRTIO_MMIO_DRIVER_FEATURES) = features;
 
   // tell device that feature negotiation is complete.
   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
   // tell device we're completely ready.
   status |= VIRTIO_CONFIG_S_DRIVER_OK;
-  *R(VIRTIO_MMIO_STATUS) = status;
+  *R(d, VIRTIO_MMIO_STATUS) = status;
 
-  *R(VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
+  *R(d, VIRTIO_MMIO_GUEST_PAGE_SIZE) = PGSIZE;
 
   // initialize queue 0.
-  *R(VIRTIO_MMIO_QUEUE_SEL) = 0;
-  uint32 max = *R(VIRTIO_MMIO_QUEUE_NUM_MAX);
+  *R(d, VIRTIO_MMIO_QUEUE_SEL) = 0;
+  uint32 max = *R(d, VIRTIO_MMIO_QUEUE_NUM_MAX);
   if(max == 0)
     panic("virtio disk has no queue 0");
   if(max < NUM)
     panic("virtio disk max queue too short");
-  *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
-  *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
+  *R(d, VIRTIO_MMIO_QUEUE_NUM) = NUM;
+  memset(d->pages, 0, sizeof(d->pages));
+  *R(d, VIRTIO_MMIO_QUEUE_PFN) = ((uint64)d->pages) >> PGSHIFT;
 
   // desc = pages -- num * virtq_desc
   // avail = pages + 0x40 -- 2 * uint16, then num * uint16
   // used = pages + 4096 -- 2 * uint16, then num * vRingUsedElem
 
-  disk.desc = (struct virtq_desc *) disk.pages;
-  disk.avail = (struct virtq_avail *)(disk.pages + NUM*sizeof(struct virtq_desc));
-  disk.used = (struct virtq_used *) (disk.pages + PGSIZE);
+  d->desc = (struct virtq_desc *) d->pages;
+  d->avail = (struct virtq_avail *)(d->pages + NUM*sizeof(struct virtq_desc));
+  d->used = (struct virtq_used *) (d->pages + PGSIZE);
 
   // all NUM descriptors start out unused.
   for(int i = 0; i < NUM; i++)
-    disk.free[i] = 1;
+    d->free[i] = 1;
+
+  // the block device's configuration space starts with its size.
+  d->capacity = *(volatile uint64 *)(base + VIRTIO_MMIO_CONFIG);
+
+  return 0;
+}
+
+void
+virtio_disk_init(void)
+{
+  if(disk_init(&disk, VIRTIO0, "virtio_disk") < 0)
+    panic("could not find virtio disk");
 
   // plic.c and trap.c arrange for interrupts from VIRTIO0_IRQ.
 }
 
+// look for the swap disk. returns its size in sectors,
+// or 0 if qemu wasn't given one.
+uint64
+virtio_swap_init(void)
+{
+  if(disk_init(&swapdisk, VIRTIO1, "virtio_swap") < 0)
+    return 0;
+
+  // plic.c and trap.c arrange for interrupts from VIRTIO1_IRQ.
+  return swapdisk.capacity;
+}
+
 // find a free descriptor, mark it non-free, return its index.
 static int
-alloc_desc()
+alloc_desc(struct disk *d)
 {
   for(int i = 0; i < NUM; i++){
-    if(disk.free[i]){
-      disk.free[i] = 0;
+    if(d->free[i]){
+      d->free[i] = 0;
       return i;
     }
   }
@@ -155,28 +193,28 @@ alloc_desc()
 
 // mark a descriptor as free.
 static void
-free_desc(int i)
+free_desc(struct disk *d, int i)
 {
   if(i >= NUM)
     panic("free_desc 1");
-  if(disk.free[i])
+  if(d->free[i])
     panic("free_desc 2");
-  disk.desc[i].addr = 0;
-  disk.desc[i].len = 0;
-  disk.desc[i].flags = 0;
-  disk.desc[i].next = 0;
-  disk.free[i] = 1;
-  wakeup(&disk.free[0]);
+  d->desc[i].addr = 0;
+  d->desc[i].len = 0;
+  d->desc[i].flags = 0;
+  d->desc[i].next = 0;
+  d->free[i] = 1;
+  wakeup(&d->free[0]);
 }
 
 // free a chain of descriptors.
 static void
-free_chain(int i)
+free_chain(struct disk *d, int i)
 {
   while(1){
-    int flag = disk.desc[i].flags;
-    int nxt = disk.desc[i].next;
-    free_desc(i);
+    int flag = d->desc[i].flags;
+    int nxt = d->desc[i].next;
+    free_desc(d, i);
     if(flag & VRING_DESC_F_NEXT)
       i = nxt;
     else
@@ -184,46 +222,48 @@ free_chain(int i)
   }
 }
 
-// allocate three descriptors (they need not be contiguous).
-// disk transfers always use three descriptors.
+// allocate n descriptors (they need not be contiguous).
 static int
-alloc3_desc(int *idx)
+alloc_descs(struct disk *d, int *idx, int n)
 {
-  for(int i = 0; i < 3; i++){
-    idx[i] = alloc_desc();
+  for(int i = 0; i < n; i++){
+    idx[i] = alloc_desc(d);
     if(idx[i] < 0){
       for(int j = 0; j < i; j++)
-        free_desc(idx[j]);
+        free_desc(d, idx[j]);
       return -1;
     }
   }
   return 0;
 }
 
-void
-virtio_disk_rw(struct buf *b, int write)
+// transfer n data buffers of len bytes each, to or from
+// consecutive sectors starting at sector, as one request.
+static void
+disk_rw(struct disk *d, uint64 sector, uint64 *data, int n, uint len, int write, int *busy)
 {
-  uint64 sector = b->blockno * (BSIZE / 512);
+  if(n < 1 || n > NUM - 2)
+    panic("disk_rw");
 
-  acquire(&disk.vdisk_lock);
+  acquire(&d->vdisk_lock);
 
   // the spec's Section 5.2 says that legacy block operations use
-  // three descriptors: one for type/reserved/sector, one for the
-  // data, one for a 1-byte status result.
+  // a descriptor for type/reserved/sector, descriptors for the
+  // data, and one for a 1-byte status result.
 
-  // allocate the three descriptors.
-  int idx[3];
+  // allocate the descriptors.
+  int idx[NUM];
   while(1){
-    if(alloc3_desc(idx) == 0) {
+    if(alloc_descs(d, idx, n + 2) == 0) {
       break;
     }
-    sleep(&disk.free[0], &disk.vdisk_lock);
+    sleep(&d->free[0], &d->vdisk_lock);
   }
 
-  // format the three descriptors.
+  // format the descriptors.
   // qemu's virtio-blk.c reads them.
 
-  struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+  struct virtio_blk_req *buf0 = &d->ops[idx[0]];
 
   if(write)
     buf0->type = VIRTIO_BLK_T_OUT; // write the disk
@@ -232,57 +272,79 @@ virtio_disk_rw(struct buf *b, int write)
   buf0->reserved = 0;
   buf0->sector = sector;
 
-  disk.desc[idx[0]].addr = (uint64) buf0;
-  disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-  disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-  disk.desc[idx[0]].next = idx[1];
+  d->desc[idx[0]].addr = (uint64) buf0;
+  d->desc[idx[0]].len = sizeof(struct virtio_blk_req);
+  d->desc[idx[0]].flags = VRING_DESC_F_NEXT;
+  d->desc[idx[0]].next = idx[1];
 
-  disk.desc[idx[1]].addr = (uint64) b->data;
-  disk.desc[idx[1]].len = BSIZE;
-  if(write)
-    disk.desc[idx[1]].flags = 0; // device reads b->data
-  else
-    disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-  disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-  disk.desc[idx[1]].next = idx[2];
+  for(int i = 1; i <= n; i++){
+    d->desc[idx[i]].addr = data[i-1];
+    d->desc[idx[i]].len = len;
+    if(write)
+      d->desc[idx[i]].flags = 0; // device reads the data
+    else
+      d->desc[idx[i]].flags = VRING_DESC_F_WRITE; // device writes the data
+    d->desc[idx[i]].flags |= VRING_DESC_F_NEXT;
+    d->desc[idx[i]].next = idx[i+1];
+  }
 
-  disk.info[idx[0]].status = 0xff; // device writes 0 on success
-  disk.desc[idx[2]].addr = (uint64) &disk.info[idx[0]].status;
-  disk.desc[idx[2]].len = 1;
-  disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-  disk.desc[idx[2]].next = 0;
+  d->info[idx[0]].status = 0xff; // device writes 0 on success
+  d->desc[idx[n+1]].addr = (uint64) &d->info[idx[0]].status;
+  d->desc[idx[n+1]].len = 1;
+  d->desc[idx[n+1]].flags = VRING_DESC_F_WRITE; // device writes the status
+  d->desc[idx[n+1]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
-  b->disk = 1;
-  disk.info[idx[0]].b = b;
+  // record the busy flag for virtio_disk_intr().
+  *busy = 1;
+  d->info[idx[0]].busy = busy;
 
   // tell the device the first index in our chain of descriptors.
-  disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+  d->avail->ring[d->avail->idx % NUM] = idx[0];
 
   __sync_synchronize();
 
   // tell the device another avail ring entry is available.
-  disk.avail->idx += 1; // not % NUM ...
+  d->avail->idx += 1; // not % NUM ...
 
   __sync_synchronize();
 
-  *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  *R(d, VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
-  while(b->disk == 1) {
-    sleep(b, &disk.vdisk_lock);
+  while(*busy == 1) {
+    sleep(busy, &d->vdisk_lock);
   }
 
-  disk.info[idx[0]].b = 0;
-  free_chain(idx[0]);
+  d->info[idx[0]].busy = 0;
+  free_chain(d, idx[0]);
 
-  release(&disk.vdisk_lock);
+  release(&d->vdisk_lock);
 }
 
 void
-virtio_disk_intr()
+virtio_disk_rw(struct buf *b, int write)
 {
-  acquire(&disk.vdisk_lock);
+  uint64 sector = b->blockno * (BSIZE / 512);
+  uint64 data = (uint64) b->data;
+
+  disk_rw(&disk, sector, &data, 1, BSIZE, write, &b->disk);
+}
+
+// read or write n pages of the swap disk, starting at sector,
+// from or to the kernel pages in pa[]. the pages need not be
+// physically contiguous; they go out as a single request.
+void
+virtio_swap_rw(uint64 sector, uint64 *pa, int n, int write)
+{
+  int busy;
+
+  disk_rw(&swapdisk, sector, pa, n, PGSIZE, write, &busy);
+}
+
+static void
+disk_intr(struct disk *d)
+{
+  acquire(&d->vdisk_lock);
 
   // the device won't raise another interrupt until we tell it
   // we've seen this interrupt, which the following line does.
@@ -290,26 +352,38 @@ virtio_disk_intr()
   // the "used" ring, in which case we may process the new
   // completion entries in this interrupt, and have nothing to do
   // in the next interrupt, which is harmless.
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  *R(d, VIRTIO_MMIO_INTERRUPT_ACK) = *R(d, VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   __sync_synchronize();
 
-  // the device increments disk.used->idx when it
+  // the device increments d->used->idx when it
   // adds an entry to the used ring.
 
-  while(disk.used_idx != disk.used->idx){
+  while(d->used_idx != d->used->idx){
     __sync_synchronize();
-    int id = disk.used->ring[disk.used_idx % NUM].id;
+    int id = d->used->ring[d->used_idx % NUM].id;
 
-    if(disk.info[id].status != 0)
+    if(d->info[id].status != 0)
       panic("virtio_disk_intr status");
 
-    struct buf *b = disk.info[id].b;
-    b->disk = 0;   // disk is done with buf
-    wakeup(b);
+    int *busy = d->info[id].busy;
+    *busy = 0;   // disk is done with the request
+    wakeup(busy);
 
-    disk.used_idx += 1;
+    d->used_idx += 1;
   }
 
-  release(&disk.vdisk_lock);
+  release(&d->vdisk_lock);
+}
+
+void
+virtio_disk_intr()
+{
+  disk_intr(&disk);
+}
+
+void
+virtio_swap_intr()
+{
+  disk_intr(&swapdisk);
 }
@@ -6,9 +6,51 @@
 #include "defs.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "proc.h"
-
-uint time = 0;
+#include "policy.h"
+#include "trace.h"
+
+#define NFRAME ((PHYSTOP - KERNBASE) / PGSIZE)
+#define TLBFLUSHMAX 32
+
+// Task 1 - the frame table has one entry per physical page and
+// describes the user page (if any) that lives in it. victims are
+// chosen from the current process' frames, or from all of them
+// under GLOBAL_RECLAIM. ftable.lock protects the entries and the
+// per-process frames lists; take it after any p->lock.
+static struct {
+  struct spinlock lock;
+  struct page frames[NFRAME];
+  struct clock clock;     // SCFIFO order of all frames, under GLOBAL_RECLAIM
+} ftable;
+
+#define PA2FRAME(pa) (&ftable.frames[((uint64)(pa) - KERNBASE) / PGSIZE])
+#define FRAME2PA(pg) (KERNBASE + (uint64)((pg) - ftable.frames) * PGSIZE)
+
+// serializes swap file I/O and changes to the resident and swapped
+// pages of tracked processes.
+struct sleeplock swap_lock;
+
+// a page of zeros. a zero page that was swapped out comes back as a
+// read-only mapping of it, copied on the first write. the reference
+// taken here keeps it from ever being freed.
+static uint64 zero_frame;
+
+static void cache_frame(uint64, uint);
+static void retrack(pagetable_t, uint64, uint64);
+static void kvmleaf(pagetable_t, uint64, int, pte_t);
+static int megalazy(struct proc*, uint64);
+static void swapin_fault(struct proc*, uint64, int);
+static int locked_pages(struct proc*, uint64, uint64);
+static int uvmfault(struct proc*, uint64, int);
+// the page-out daemon. under GLOBAL_RECLAIM it keeps free memory
+// between LOW_WATERMARK and HIGH_WATERMARK, so that a fault usually
+// finds a free frame instead of writing a page out itself.
+struct {
+  struct spinlock lock;
+  int wanted;             // free memory went below LOW_WATERMARK
+} swapd;
 
 /*
  * the kernel's page table.
@@ -19,6 +61,8 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+extern struct proc proc[NPROC];
+
 // Make a direct-map page table for the kernel.
 pagetable_t
 kvmmake(void)
@@ -34,6 +78,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // virtio mmio swap disk interface
+  kvmmap(kpgtbl, VIRTIO1, VIRTIO1, PGSIZE, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -41,6 +88,8 @@ kvmmake(void)
   kvmmap(kpgtbl, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
 
   // map kernel data and the physical RAM we'll make use of.
+  // past the first 2MB boundary after etext this is all
+  // megapages.
   kvmmap(kpgtbl, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
 
   // map the trampoline for trap entry/exit to
@@ -60,15 +109,62 @@ kvminit(void)
   kernel_pagetable = kvmmake();
 }
 
+void
+frameinit(void)
+{
+  initlock(&ftable.lock, "ftable");
+  initsleeplock(&swap_lock, "swap");
+  initlock(&swapd.lock, "kswapd");
+  for(int i = 0; i < NFRAME; i++)
+    ftable.frames[i].state = P_UNUSED;
+
+  if((zero_frame = (uint64)kalloc()) == 0)
+    panic("frameinit");
+  memset((void*)zero_frame, 0, PGSIZE);
+}
+
 // Switch h/w page table register to the kernel's page table,
 // and enable paging.
 void
 kvminithart()
 {
-  w_satp(MAKE_SATP(kernel_pagetable));
+  w_satp(MAKE_SATP(kernel_pagetable, 0));
   sfence_vma();
 }
 
+// Task 1 - npages pages of p's page table from va on (0 for all
+// of it) changed. flush them from this hart's TLB, and have every
+// other hart flush p's ASID before it runs p again. past
+// TLBFLUSHMAX pages the whole ASID goes.
+void
+tlbflush(struct proc *p, uint64 va, uint64 npages)
+{
+  uint64 asid;
+
+  if(p == 0)
+    return;
+  push_off();
+  __sync_fetch_and_or(&p->tlbstale, ~(1L << cpuid()));
+  asid = p->asid & ASIDMASK;
+  if(asid != 0 && (npages == 0 || npages > TLBFLUSHMAX)) {
+    sfence_vma_asid(asid);
+  } else if(asid != 0) {
+    for(; npages > 0; npages--, va += PGSIZE)
+      sfence_vma_page(va, asid);
+  }
+  pop_off();
+}
+
+// the current process, if pagetable is its page table: no
+// other process can have TLB entries made with it.
+static struct proc*
+tlbowner(pagetable_t pagetable)
+{
+  struct proc *p = myproc();
+
+  return p != 0 && pagetable == p->pagetable ? p : 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -81,6 +177,8 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+// A megapage maps 2MB with a leaf at level 1; walk()
+// returns that PTE for any va in it.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
@@ -90,6 +188,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   for(int level = 2; level > 0; level--) {
     pte_t *pte = &pagetable[PX(level, va)];
     if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        return pte;
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
       if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
@@ -101,8 +201,23 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
-// Look up a virtual address, return the physical address,
-// or 0 if not mapped.
+// The level-1 PTE of the megapage that maps va,
+// or 0 if va isn't in one.
+pte_t *
+megapte(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte = &pagetable[PX(2, va)];
+
+  if((*pte & PTE_V) == 0 || PTE_LEAF(*pte))
+    return 0;
+  pte = &((pagetable_t)PTE2PA(*pte))[PX(1, va)];
+  if((*pte & PTE_V) == 0 || !PTE_LEAF(*pte))
+    return 0;
+  return pte;
+}
+
+// Look up a virtual address, return the physical address
+// of its page, or 0 if not mapped.
 // Can only be used to look up user pages.
 uint64
 walkaddr(pagetable_t pagetable, uint64 va)
@@ -121,17 +236,64 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return 0;
   pa = PTE2PA(*pte);
+  if(megapte(pagetable, va) == pte)
+    pa += PGROUNDDOWN(va) & (MEGASIZE-1);
   return pa;
 }
 
-// add a mapping to the kernel page table.
+// add a mapping to the kernel page table, with the largest
+// leaves that va, pa and sz allow: 1GB at level 2, 2MB at
+// level 1, and 4KB pages at the unaligned edges.
 // only used when booting.
 // does not flush TLB or enable paging.
 void
 kvmmap(pagetable_t kpgtbl, uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kpgtbl, va, sz, pa, perm) != 0)
-    panic("kvmmap");
+  uint64 end = va + sz, n;
+  int level;
+
+  while(va < end){
+    for(level = 2; level > 0; level--){
+      n = 1L << PXSHIFT(level);
+      if(va % n == 0 && pa % n == 0 && va + n <= end)
+        break;
+    }
+    if(level == 0){
+      n = PGSIZE;
+      if(mappages(kpgtbl, va, n, pa, perm) != 0)
+        panic("kvmmap");
+    } else {
+      kvmleaf(kpgtbl, va, level, PA2PTE(pa) | perm | PTE_V);
+    }
+    va += n;
+    pa += n;
+  }
+}
+
+// install pte as the leaf for va at level, allocating
+// the page-table pages above it.
+static void
+kvmleaf(pagetable_t pagetable, uint64 va, int level, pte_t pte)
+{
+  pte_t *p;
+
+  for(int l = 2; l > level; l--){
+    p = &pagetable[PX(l, va)];
+    if(*p & PTE_V){
+      if(PTE_LEAF(*p))
+        panic("kvmleaf: remap");
+      pagetable = (pagetable_t)PTE2PA(*p);
+    } else {
+      if((pagetable = (pde_t*)kalloc()) == 0)
+        panic("kvmleaf");
+      memset(pagetable, 0, PGSIZE);
+      *p = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  p = &pagetable[PX(level, va)];
+  if(*p & PTE_V)
+    panic("kvmleaf: remap");
+  *p = pte;
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
@@ -161,7 +323,9 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
+// page-aligned. Heap pages that were never touched have
+// no mapping and are skipped. A megapage that is only
+// partly in the range is split first.
 // Optionally free the physical memory.
 void
 uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
@@ -173,20 +337,35 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
     panic("uvmunmap: not aligned");
 
   for(a = va; a < va + npages*PGSIZE; a += PGSIZE){
+    if((pte = megapte(pagetable, a)) != 0){
+      if(a % MEGASIZE == 0 && a + MEGASIZE <= va + npages*PGSIZE){
+        if(do_free)
+          megafree((void*)PTE2PA(*pte));
+        *pte = 0;
+        a += MEGASIZE - PGSIZE;
+        continue;
+      }
+      if(megasplit(pagetable, a) < 0)
+        panic("uvmunmap: split");
+    }
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("uvmunmap: walk");
-//    if((*pte & PTE_V) == 0)
+      continue;
     if((*pte & PTE_V) == 0 && (*pte & PTE_PG)==0)
-      panic("uvmunmap: not mapped");
+      continue;
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("uvmunmap: not a leaf");
-//    if(do_free){
-    if(do_free && ((*pte & PTE_PG) == 0)){
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+    if(do_free){
+      if(*pte & PTE_PG){
+        remove_swap_page(pagetable, pte);
+      } else {
+        uint64 pa = PTE2PA(*pte);
+        remove_page_from_phys_mem(pagetable, a, pa);
+        kfree((void*)pa);
+      }
     }
     *pte = 0;
   }
+  tlbflush(tlbowner(pagetable), va, npages);
 }
 
 // create an empty user page table.
@@ -220,32 +399,27 @@ uvminit(pagetable_t pagetable, uchar *src, uint sz)
 
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
+// Growing the current process' own page table tracks the new pages
+// for replacement; the caller must hold swap_lock in that case.
 uint64
 uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
-  int physical_page = myproc()->num_of_phys_pages;
-  int swap_pages = myproc()->num_of_swap_pages;
   uint64 a;
-  int total_pages = physical_page + swap_pages;
-  if(total_pages == MAX_TOTAL_PAGES) {
-      panic("impossible to alloc page - reach to max size");
-  }
+  struct proc *p = myproc();
+  int track = 0;
+
+  #ifndef NONE
+    track = p != 0 && p->pid > 2 && pagetable == p->pagetable;
+  #endif
 
   if(newsz < oldsz)
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  int idx_counter = 0;
   for(a = oldsz; a < newsz; a += PGSIZE){
-    idx_counter++;
-      #ifndef NONE
-        if(myproc()!=0 && myproc()->pid > 2) {
-            if(myproc()->num_of_phys_pages == MAX_PSYC_PAGES) {
-                free_one_page();
-            }
-        }
-    #endif
+    if(track)
+      ensure_free_frame(p);
     mem = kalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
@@ -257,12 +431,8 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-
-    #ifndef  NONE
-      if(myproc()!=0 && myproc()->pid > 2) { //now we want to add the physical page to the memory
-          add_page_to_phys_mem(a);
-      }
-    #endif
+    if(track) //now we want to add the physical page to the memory
+      add_page_to_phys_mem(p, pagetable, a, (uint64)mem);
   }
   return newsz;
 }
@@ -272,88 +442,19 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
 uint64
-uvmdeallocnew(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
-//    pte_t *pte;
-//    uint64 add;
-//    uint pa;
   if(newsz >= oldsz)
     return oldsz;
 
-//  add = PGROUNDUP(newsz);
-//  for(;add<oldsz;add+=PGSIZE) {
-//      pte = walk(pagetable, add,0);
-//    #ifndef NONE
-//        int found = 0;
-//        int i;
-//        for(i=0; i<MAX_PSYC_PAGES; i++) {
-//            if((myproc()->phys_pages[i].virtual_add == add) && (myproc()->phys_pages[i].state == P_USED)) { //search for the desired physical page
-//                found = i;
-//                break;
-//            }
-//        }
-//    #endif
-//    if(!pte) {
-//        uint pdx = (((uint)(add) >> 22) & 0x3FF); // 22 = offset of PDX in a linear address
-//        add = (uint)((pdx+1) << 22) - PGSIZE;
-//    } else if((*pte & PTE_V) != 0) { // this page is present in the physical memo
-//        pa = ((uint)(*pte) & ~0xFFF);
-//        if(pa==0) {
-//            panic("panic during deallocuvm - caused by kfree");
-//        }
-//        //remove page from physical memory
-//    #ifndef NONE
-//    if(found) {
-//        remove_page_from_memo(pagetable, add, myproc()->phys_pages);
-//        if(myproc()->num_of_phys_pages > 0) {
-//            myproc()->num_of_phys_pages--;
-//        }
-//    }
-//    #endif
-//
-//    uint64 v = PA2PTE(pa); //TODO wrong macro?
-//    kfree((void*)v);
-//    } else if((*pte & PTE_PG) > 0) { //remove the page from swap memory iff the page is not in the memo
-//        #ifndef NONE
-//            remove_page_from_memo(pagetable, add, myproc()->swap_pages);
-//            if(myproc()->num_of_swap_pages > 0) {
-//                myproc()->num_of_swap_pages--;
-//            }
-//            *pte = 0;
-//        #endif
-//    }
-////
-////    return newsz; //TODO compare dealloc
-//  }
-
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
     uvmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
-    for (int a = PGROUNDDOWN(oldsz); a > PGROUNDDOWN(newsz); a -= PGSIZE) {
-        if(myproc()!=0 && myproc()->pid > 2){
-            remove_page_from_memo(0,a,myproc()->phys_pages);
-        }
-
-    }
   }
 
   return newsz;
 }
 
-uint64
-uvmdealloc(pagetable_t pte, uint64 oldsz, uint64 newsz)
-{
-    if(myproc()!=0 && myproc()->pid > 2) {
-        return uvmdeallocnew(pte, oldsz ,newsz);
-    }
-
-    if(newsz >= oldsz) {
-        return oldsz;
-    } else {
-        return newsz;
-    }
-}
-
 // Recursively free page-table pages.
 // All leaf mappings must already have been removed.
 void
@@ -386,51 +487,211 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Resident pages are shared copy-on-write: both
+// sides map the same frame without PTE_W until
+// one of them writes. Paged-out PTEs are copied
+// as they are; fork copies their swap slots.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  pte_t *pte, *npte;
   uint64 pa, i;
   uint flags;
-  char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
+    if(megapte(old, i) && megasplit(old, i) < 0) //shared 4KB at a time
+      goto err;
     if((pte = walk(old, i, 0)) == 0)
-      panic("uvmcopy: pte should exist");
+      continue; //never touched
     if((*pte & PTE_V) == 0 && (*pte & PTE_PG) == 0)
-      panic("uvmcopy: page not present");
+      continue;
+    if(*pte & PTE_PG){
+      if((npte = walk(new, i, 1)) == 0)
+        goto err;
+      *npte = *pte;
+      continue;
+    }
     pa = PTE2PA(*pte);
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     flags = PTE_FLAGS(*pte);
-    if ((flags & PTE_PG) == 0) {
-        if ((mem = kalloc()) == 0)
-            goto err;
-        memmove(mem, (char *) pa, PGSIZE);
-    }
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
+    if(mappages(new, i, PGSIZE, pa, flags) != 0)
       goto err;
-    }
+    krefinc((void*)pa);
   }
+  tlbflush(tlbowner(old), 0, 0);
   return 0;
 
  err:
+  tlbflush(tlbowner(old), 0, 0);
   uvmunmap(new, 0, i / PGSIZE, 1);
   return -1;
 }
 
-//int
-//uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
-//{
-//    if(myproc()!=0 && myproc()->pid > 2) {
-//        return uvmcopynew(old, new, sz);
-//    }
-//
-//    return 0;
-//}
+// Map the page at va of p on its first touch:
+// exec() and sbrk() only reserve the address space.
+// mem holds a page of text or data the caller read
+// in from the executable with execload(); without
+// it the page is zero-filled. The page is tracked for
+// replacement; the caller makes room for it first if
+// it can sleep. Returns 0 on success, -1 if memory
+// ran out.
+int
+uvmlazy(struct proc *p, uint64 va, char *mem)
+{
+  int track = 0;
+
+  #ifndef NONE
+    track = p->pid > 2;
+  #endif
+
+  va = PGROUNDDOWN(va);
+  if(mem == 0 && megalazy(p, va) == 0) {
+    tlbflush(p, va, 1);
+    return 0;
+  }
+  if(mem == 0) {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+  }
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0){
+    kfree(mem);
+    return -1;
+  }
+  if(track)
+    add_page_to_phys_mem(p, p->pagetable, va, (uint64)mem);
+  tlbflush(p, va, 1);
+  return 0;
+}
+
+// Can p have megapages? They are left out of page replacement, so
+// only where no per-process resident limit counts pages: without
+// paging, or under GLOBAL_RECLAIM, where they hold at most NMEGA
+// blocks of memory and fork or a partial unmap splits them back.
+static int
+megaok(struct proc *p)
+{
+  #if defined(NONE) || defined(GLOBAL_RECLAIM)
+    return 1;
+  #else
+    return 0;
+  #endif
+}
+
+// Map a zeroed megapage over the untouched 2MB block of p's heap
+// around va, if the whole block is reserved and holds no page of
+// the executable. Returns 0 on success, -1 to fall back to pages.
+static int
+megalazy(struct proc *p, uint64 va)
+{
+  uint64 base = MEGAROUNDDOWN(va);
+  struct segment *seg;
+  pagetable_t l1;
+  pte_t *pte;
+  char *mem;
+
+  if(!megaok(p) || base + MEGASIZE > p->sz)
+    return -1;
+  for(seg = p->segs; seg < &p->segs[p->nseg]; seg++) {
+    if(seg->vaddr < base + MEGASIZE && seg->vaddr + seg->filesz > base)
+      return -1;
+  }
+  //the level-1 PTE: nothing in the block may be mapped yet
+  pte = &p->pagetable[PX(2, base)];
+  if((*pte & PTE_V) == 0) {
+    if((l1 = (pagetable_t)kalloc()) == 0)
+      return -1;
+    memset(l1, 0, PGSIZE);
+    *pte = PA2PTE(l1) | PTE_V;
+  }
+  pte = &((pagetable_t)PTE2PA(*pte))[PX(1, base)];
+  if(*pte != 0)
+    return -1;
+  if((mem = megaalloc()) == 0)
+    return -1;
+  memset(mem, 0, MEGASIZE);
+  *pte = PA2PTE(mem) | PTE_W|PTE_X|PTE_R|PTE_U|PTE_V;
+  return 0;
+}
+
+// Split the megapage around va of pagetable into pages,
+// each on its own from then on. Pages of the current process
+// get tracked for replacement; the caller must hold swap_lock
+// in that case. Returns 0, or -1 if memory ran out.
+int
+megasplit(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  uint64 base = MEGAROUNDDOWN(va), pa;
+  pagetable_t l0;
+  pte_t *pte;
+  int i, track = 0;
+
+  #ifndef NONE
+    track = p != 0 && p->pid > 2 && pagetable == p->pagetable;
+  #endif
+
+  if((pte = megapte(pagetable, va)) == 0)
+    return 0;
+  if((l0 = (pagetable_t)kalloc()) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  for(i = 0; i < 512; i++)
+    l0[i] = PA2PTE(pa + i*PGSIZE) | PTE_FLAGS(*pte);
+  *pte = PA2PTE(l0) | PTE_V;
+  tlbflush(tlbowner(pagetable), base, 1);
+  if(track) {
+    for(i = 0; i < 512; i++)
+      add_page_to_phys_mem(p, pagetable, base + i*PGSIZE, pa + i*PGSIZE);
+  }
+  return 0;
+}
+
+// Resolve a write to the copy-on-write page at va.
+// The last process sharing the frame takes it over,
+// the others get a private copy. Pages of the
+// current process are tracked for replacement;
+// the caller must hold swap_lock in that case.
+// Returns 0 on success, -1 if va isn't a
+// copy-on-write page or memory ran out.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+  int track = 0;
+
+  #ifndef NONE
+    track = p != 0 && p->pid > 2 && pagetable == p->pagetable;
+  #endif
+
+  if(va >= MAXVA || (pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || (*pte & PTE_COW) == 0)
+    return -1;
+
+  pa = PTE2PA(*pte);
+  if(krefcnt((void*)pa) == 1){
+    mem = (char*)pa;
+  } else {
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, (char*)pa, PGSIZE);
+    if(track)
+      remove_page_from_phys_mem(pagetable, va, pa);
+    kfree((void*)pa);
+  }
+  *pte = PA2PTE(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+  if(track)
+    add_page_to_phys_mem(p, pagetable, va, (uint64)mem);
+  tlbflush(tlbowner(pagetable), va, 1);
+  return 0;
+}
 
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
@@ -445,6 +706,42 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// Look up user page va0 for a copy to or from the kernel, like
+// walkaddr(). A page of the current process is brought in the
+// way a page fault would: see uvmfault(). That sleeps and takes
+// swap_lock, whose holder may page out through the file system,
+// so under a spinlock, any sleeplock (an inode's, a buffer's) or
+// in a log transaction only a page that is resident (and not shared copy-on-write,
+// for a write) can be copied; the caller brings the pages in
+// with uvmprefault() first, and if a copy still fails, drops its
+// locks, prefaults again and retries.
+// Return the physical address, or 0.
+static uint64
+uvmcopyaddr(pagetable_t pagetable, uint64 va0, int write)
+{
+  struct proc *p = myproc();
+  pte_t *pte;
+  uint64 pa;
+  int mine;
+
+  if(va0 >= MAXVA)
+    return 0;
+  mine = p != 0 && pagetable == p->pagetable && va0 < p->sz;
+  if(mine && intr_get() && p->locksheld == 0){
+    if(uvmfault(p, va0, write) < 0)
+      return 0;
+  } else if(write && (pte = walk(pagetable, va0, 0)) != 0 && (*pte & PTE_COW)){
+    if(mine || uvmcow(pagetable, va0) < 0)
+      return 0;
+  }
+  if((pa = walkaddr(pagetable, va0)) == 0)
+    return 0;
+  pte = walk(pagetable, va0, 0);
+  if(write)
+    *pte |= PTE_D; //the kernel writes through its own mapping, which leaves the user PTE clean
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -455,7 +752,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmcopyaddr(pagetable, va0, 1);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -480,7 +777,7 @@ copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmcopyaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -507,7 +804,7 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = uvmcopyaddr(pagetable, va0, 0);
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -538,27 +835,189 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
+//allocate the untouched page at va of p, making room for it first. a
+//page of the executable is read in without swap_lock held, since a
+//process inside readi() or writei() on it holds its lock and may be
+//paging in or out itself. nothing else maps or evicts the page meanwhile:
+//only p maps its untouched pages, and only resident ones are evicted.
+static int
+lazy_fault(struct proc *p, uint64 va)
+{
+  char *mem = 0;
+  int r;
+
+  va = PGROUNDDOWN(va);
+  if(execseg(p, va)) {
+    #ifndef NONE
+      if(p->pid > 2) {
+        acquiresleep(&swap_lock);
+        ensure_free_frame(p);
+        releasesleep(&swap_lock);
+      }
+    #endif
+    if((mem = kalloc()) == 0)
+      return -1;
+    memset(mem, 0, PGSIZE);
+    if(execload(p, va, mem) < 0) {
+      kfree(mem);
+      return -1;
+    }
+  }
+  #ifndef NONE
+    if(p->pid > 2) {
+      acquiresleep(&swap_lock);
+      ensure_free_frame(p);
+    }
+  #endif
+  r = uvmlazy(p, va, mem);
+  #ifndef NONE
+    if(p->pid > 2)
+      releasesleep(&swap_lock);
+  #endif
+  return r;
+}
+
+//break copy-on-write sharing of the page at va of p for a write, making
+//room first. making room may page this very page out; that isn't an
+//error, the next access brings it back. returns 0, or -1 if memory ran out.
+static int
+cow_fault(struct proc *p, uint64 va)
+{
+  pte_t *pte;
+  int r = 0;
+
+  va = PGROUNDDOWN(va);
+  #ifndef NONE
+    if(p->pid > 2) {
+      acquiresleep(&swap_lock);
+      ensure_free_frame(p);
+    }
+  #endif
+  pte = walk(p->pagetable, va, 0);
+  if(uvmcow(p->pagetable, va) < 0 && (pte == 0 || !is_paged_out(pte)))
+    r = -1;
+  #ifndef NONE
+    if(p->pid > 2)
+      releasesleep(&swap_lock);
+  #endif
+  return r;
+}
+
+//swap the paged-out page at va of p back in.
+static void
+swapin_fault(struct proc *p, uint64 va, int write)
+{
+  #ifndef NONE
+    pte_t *pte;
+
+    acquiresleep(&swap_lock);
+    pte = walk(p->pagetable, va, 0);
+    if(pte && is_paged_out(pte)) { //evicted pages only change under swap_lock
+      p->total_page_faults++;
+      pgstat_fault(p, handle_page_out(PGROUNDDOWN(va), pte, write));
+    }
+    releasesleep(&swap_lock);
+  #endif
+}
+
+//make the page at va of p ready for the kernel to copy to (write) or
+//from, the way a page fault would: allocate it on first touch, swap it
+//in, or break copy-on-write sharing for a write. making room for one
+//step can page the page out again, so repeat until it stays. may sleep.
+//returns 0, or -1 if the page can't be brought in.
+static int
+uvmfault(struct proc *p, uint64 va, int write)
+{
+  pte_t *pte;
+
+  va = PGROUNDDOWN(va);
+  for(;;) {
+    pte = walk(p->pagetable, va, 0);
+    if(pte == 0 || (*pte & (PTE_V | PTE_PG)) == 0) {
+      if(lazy_fault(p, va) < 0)
+        return -1;
+    } else if(is_user_access_disabled(pte)) {
+      return -1;
+    } else if(is_paged_out(pte)) {
+      swapin_fault(p, va, write);
+    } else if(write && (*pte & PTE_COW)) {
+      if(cow_fault(p, va) < 0)
+        return -1;
+    } else {
+      return 0;
+    }
+  }
+}
+
+//bring [va, va+len) of the current process in before a copy that runs
+//under a lock and can't fault pages in itself. until the copy, other
+//processes may page them out again, and under LOCAL_RECLAIM a long range
+//can push its own start out; the copy then fails, and the caller drops
+//the lock, prefaults the page it stopped at and retries. returns 0, or -1
+//if a page isn't part of the process or can't be brought in.
+int
+uvmprefault(uint64 va, uint64 len, int write)
+{
+  struct proc *p = myproc();
+  uint64 a;
+
+  if(va + len < va)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE) {
+    if(a >= p->sz || uvmfault(p, a, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 int
 handle_page_fault(void)
 {
+  struct proc *p = myproc();
   uint64 virt_add = r_stval();
-  pte_t *pte = walk(myproc()->pagetable, virt_add, 0);
-  if(virt_add >= KERNBASE || pte == 0 || is_user_access_disabled(pte)) { //3rd cond: if the file is not accessible to user - don't try to bring it to memory
-//    myproc()->total_page_faults++;
-    myproc()->killed = 1; //TODO should we increase total_page_fault
+  pte_t *pte;
+  if(virt_add >= KERNBASE) {
+    p->killed = 1;
+    return 0;
+  }
+  trace_event(TR_FAULT, p->pid, PGROUNDDOWN(virt_add), r_scause() == 15);
+
+  //first touch of a page exec() or sbrk() only reserved
+  pte = walk(p->pagetable, virt_add, 0);
+  if(pte == 0 || (*pte & (PTE_V | PTE_PG)) == 0) {
+    if(virt_add >= p->sz)
+      return 1;
+    pgstat_fault(p, 0);
+    if(lazy_fault(p, virt_add) < 0)
+      p->killed = 1;
     return 0;
   }
 
-  #ifndef NONE
-    if(is_paged_out(pte)) { //if PG flag is on - means that we had this page before in our memory
-        //TODO should we increase total_page_fault
-        //PGROUNDOWN returns the offset (first 12 bits) of the VA
-        myproc()->total_page_faults++;
-        uint64 rounded = PGROUNDDOWN(virt_add);
-            handle_page_out(rounded, pte);
-            return 0;
-    }
-  #endif
+  if(is_user_access_disabled(pte)) { //if the page is not accessible to user - don't try to bring it to memory
+    p->killed = 1;
+    return 0;
+  }
+
+  //write to a page shared copy-on-write since fork
+  if(r_scause() == 15 && (*pte & PTE_V) && (*pte & PTE_COW)) {
+    pgstat_fault(p, 0);
+    if(cow_fault(p, virt_add) < 0)
+      p->killed = 1;
+    return 0;
+  }
+
+  if(is_paged_out(pte)) { //if PG flag is on - means that we had this page before in our memory
+    swapin_fault(p, virt_add, r_scause() == 15);
+    return 0;
+  }
+
+  //hardware that doesn't set the dirty bit itself faults on the first write instead
+  if(r_scause() == 15 && (*pte & PTE_V) && (*pte & PTE_W) && (*pte & PTE_D) == 0) {
+    pgstat_fault(p, 0);
+    *pte |= PTE_D | PTE_A;
+    tlbflush(p, PGROUNDDOWN(virt_add), 1);
+    return 0;
+  }
 
   return 1;
 }
@@ -590,307 +1049,966 @@ is_paged_out(pte_t* pte)
   return 0;
 }
 
-void
-handle_page_out(uint64 va, pte_t* pte)
+//how many pages p can read ahead without anything being evicted for them
+static int
+readahead_room(struct proc *p)
 {
-  int is_found = 0;
-  if(myproc()->num_of_phys_pages == MAX_PSYC_PAGES) {
-    //achieved maximum page size
-    free_one_page();
-  }
+  #ifdef GLOBAL_RECLAIM
+    return getFreePagesAmountFromKalloc() - LOW_WATERMARK;
+  #else
+    return MAX_PSYC_PAGES - p->num_of_phys_pages - 1;
+  #endif
+}
 
-//  uint p_add = PTE2PA((uint64)addr); //TODO right macro?
-//  *pte = /*p_add | */PTE_V | PTE_U | PTE_W;
-//  *pte = *pte & ~PTE_PG; //indicate that the page is not paged-out
+//was the page at pa all zeros?
+static int
+is_zero_page(uint64 pa)
+{
+  uint64 *w = (uint64*)pa;
+
+  for(int i = 0; i < PGSIZE/sizeof(uint64); i++) {
+    if(w[i])
+      return 0;
+  }
+  return 1;
+}
 
-  int idx;
+//bring the page at va back from swap space, along with the pages after it
+//that are paged out too (read-ahead). with a raw swap area those must sit
+//in the following slots, so they all come in with one request. a zero
+//page needs no I/O: a read maps the shared zero frame copy-on-write, a
+//write gets a fresh page. no read-ahead in a range madvise()d
+//MADV_RANDOM. swap_lock must be held. returns 1 if swap space was read.
+int
+handle_page_out(uint64 va, pte_t* pte, int write)
+{
   struct proc* p = myproc();
-  for(idx = 0; idx < MAX_PSYC_PAGES; idx++) {
-    if(p->swap_pages[idx].state == P_USED && p->swap_pages[idx].virtual_add == va) {
-      is_found = 1;
-      break;
-    }
+  pte_t *ptes[SWAPCLUSTER];
+  uint64 pas[SWAPCLUSTER];
+  uint64 a, t;
+  int i, n, room, keep, zero;
+  uint flags, off;
+
+  if(!is_paged_out(pte)) { //sanity check
+    panic("handle page out: page is not paged out");
   }
-  if(is_found == 0) { //sanity check
-    panic("handle page out: couldn't find a valid page");
+  ptes[0] = pte;
+  zero = (*pte & PTE_Z) != 0;
+
+  if(zero && !write) {
+    flags = (PTE_FLAGS(*pte) & ~PTE_PG) | PTE_V;
+    if(flags & PTE_W)
+      flags = (flags & ~PTE_W) | PTE_COW;
+    krefinc((void*)zero_frame);
+    *pte = PA2PTE(zero_frame) | flags;
+    p->num_of_swap_pages--;
+    pgstat_in(p, 0);
+    tlbflush(p, va, 1);
+    return 0;
   }
 
-  //bring the data we want from the secondary memory (swap file) into the main memory
-  char* buffer;
-  if ( (buffer = kalloc()) == 0 ) {
-      panic("failed to kalloc");
+  ensure_free_frame(p);
+
+  room = advice_of(p, va) == MADV_RANDOM ? 0 : readahead_room(p);
+  for(n = 1; !zero && n < SWAPCLUSTER && n <= room; n++) {
+    a = va + n*PGSIZE;
+    if(a >= p->sz || (ptes[n] = walk(p->pagetable, a, 0)) == 0 || !is_paged_out(ptes[n]))
+      break;
+    if(*ptes[n] & PTE_Z)
+      break;
+    if(rawswap() && PTE2SWAP(*ptes[n]) != PTE2SWAP(*pte) + n*PGSIZE)
+      break;
   }
 
-  char* mem;
-  if ( (mem = kalloc()) == 0 ) {
-      panic("failed to kalloc");
+  //bring the data we want from the secondary memory (swap space) into the main memory
+  for(i = 0; i < n; i++) {
+    if((pas[i] = (uint64)kalloc()) == 0) {
+      if(i == 0)
+        panic("failed to kalloc");
+      n = i; //no memory to read ahead
+      break;
+    }
   }
 
-  if(readFromSwapFile(p, buffer, idx*PGSIZE, PGSIZE) == -1) { //sanity check
-    panic("handle page out: unable to read data from swap_file");
+  t = r_time();
+  if(zero) {
+    memset((void*)pas[0], 0, PGSIZE);
+  } else if(rawswap()) {
+    swapreadv(PTE2SWAP(*pte), pas, n);
+  } else {
+    for(i = 0; i < n; i++) {
+      if(swapread(p, (char*)pas[i], PTE2SWAP(*ptes[i]), PGSIZE) != PGSIZE) { //sanity check
+        panic("handle page out: unable to read data from swap space");
+      }
+    }
+  }
+  if(!zero)
+    pgstat_lat(p, 0, r_time() - t);
+
+  for(i = 0; i < n; i++) {
+    a = va + i*PGSIZE;
+    keep = !zero && swapcacheok(p);
+    off = PTE2SWAP(*ptes[i]);
+
+    //a page that keeps its swap copy is mapped clean, so that eviction can tell if it was written
+    *ptes[i] = PA2PTE(pas[i]) | ((PTE_FLAGS(*ptes[i]) & ~(PTE_PG | PTE_D)) | PTE_V);
+    if(!zero && !keep)
+      swapdiscard(p, off);
+    p->num_of_swap_pages--;
+
+    pgstat_in(p, !zero);
+    add_page_to_phys_mem(p, p->pagetable, a, pas[i]);
+    if(keep)
+      cache_frame(pas[i], off);
   }
 
-  memmove(mem,buffer,PGSIZE);
-  int new_flag = (PTE_FLAGS(*pte) & ~PTE_PG) | PTE_V | PTE_U | PTE_W;
-  *pte = PA2PTE(mem) | new_flag;
-//  *pte = PA2PTE(buffer) | PTE_FLAGS(*pte) | PTE_V;
-//  *pte = *pte & ~PTE_PG; //indicate that the page is not paged-out
-//  *pte = *pte | PTE_V;
-//  memmove((void*) PTE2PA(va), buffer, PGSIZE); // change the data of va (virtual address we want) to point to buffer, which includes the swap_file data
-  
-  //initialize current index under swap_pages array
-//  va = buffer; // update pte using the npa
-  p->swap_pages[idx].offset = 0;
-  p->swap_pages[idx].c_time = 0;
-  p->swap_pages[idx].virtual_add = 0;
-  p->swap_pages[idx].state = P_UNUSED;
-  p->num_of_swap_pages--;
+  tlbflush(p, va, n);
+  return !zero;
+}
 
-  #if NFUA
-    p->swap_pages[idx].counter = 0;
-  #elif LAPA
-    p->swap_pages[idx].counter = 0xFFFFFFFF;
+//the page-out daemon: evicts pages until free memory is back at
+//HIGH_WATERMARK whenever a process finds it below LOW_WATERMARK.
+//pages go out SWAPCLUSTER at a time, and swap_lock is taken per batch
+//so faults can slip in between.
+void
+kswapd(void)
+{
+  struct proc *p = myproc();
+  int r;
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  for(;;) {
+    acquire(&swapd.lock);
+    while(swapd.wanted == 0)
+      sleep(&swapd, &swapd.lock);
+    swapd.wanted = 0;
+    release(&swapd.lock);
+
+    while(getFreePagesAmountFromKalloc() < HIGH_WATERMARK) {
+      acquiresleep(&swap_lock);
+      r = free_pages(p, SWAPCLUSTER);
+      releasesleep(&swap_lock);
+      if(r == 0)
+        break;
+    }
+  }
+}
+
+void
+wake_kswapd(void)
+{
+  acquire(&swapd.lock);
+  swapd.wanted = 1;
+  wakeup(&swapd);
+  release(&swapd.lock);
+}
+
+//start the page-out daemon. only GLOBAL_RECLAIM needs it: otherwise each
+//process only evicts its own pages, when it reaches MAX_PSYC_PAGES.
+void
+kswapdinit(void)
+{
+  #if defined(GLOBAL_RECLAIM) && !defined(NONE)
+    kthread("kswapd", kswapd);
   #endif
+}
 
-  add_page_to_phys_mem(va);
-  
-  sfence_vma();
+//make room for one more resident page of p: under GLOBAL_RECLAIM evict
+//only when free memory runs low, otherwise keep p under MAX_PSYC_PAGES.
+//swap_lock must be held.
+void
+ensure_free_frame(struct proc *p)
+{
+  #ifdef GLOBAL_RECLAIM
+    if(getFreePagesAmountFromKalloc() < LOW_WATERMARK)
+      wake_kswapd();
+    //kswapd fell behind, evict here
+    while(getFreePagesAmountFromKalloc() < MIN_WATERMARK) {
+      if(free_one_page(p) < 0)
+        break;
+    }
+  #else
+    while(p->num_of_phys_pages >= MAX_PSYC_PAGES) {
+      if(free_one_page(p) < 0)
+        break;
+    }
+  #endif
 }
 
-//this function adds the provided pte to physical pages array
+//the clock p's frames go on: one for the whole frame table under
+//GLOBAL_RECLAIM, p's own otherwise.
+struct clock*
+clock_of(struct proc *p)
+{
+  #ifdef GLOBAL_RECLAIM
+    return &ftable.clock;
+  #else
+    return &p->clock;
+  #endif
+}
+
+//forget the pages p paged out, as p goes away or exec() replaces its image.
+void
+forget_ghosts(struct proc *p)
+{
+  acquire(&ftable.lock);
+  ghost_forget(p);
+  release(&ftable.lock);
+}
+
+//this function adds the user page at va of p, living in frame pa, to the frame table
 void
-add_page_to_phys_mem(uint64 add)
+add_page_to_phys_mem(struct proc *p, pagetable_t pagetable, uint64 add, uint64 pa)
 {
   struct page *free_pg;
-  struct proc *p = myproc();
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    if(p->phys_pages[i].state == P_UNUSED) {
-      p->num_of_phys_pages++;
-      free_pg = &p->phys_pages[i];
-      free_pg->state = P_USED;
-      free_pg->offset = i*PGSIZE;
-      free_pg->virtual_add = add;
-
-      #if NFUA
-        free_pg->counter = 0;
-      #elif LAPA
-        free_pg->counter = 0xFFFFFFFF;
-      #elif SCFIFO
-        free_pg->c_time = ++time; //set and increase time
-      #endif
-      
-      break;
-    }
+
+  if(pa == zero_frame) //the shared zero frame is never paged out
+    return;
+  acquire(&ftable.lock);
+  free_pg = PA2FRAME(pa);
+  if(free_pg->state == P_USED) {
+    //a frame shared copy-on-write stays with the mapping that tracked it first
+    release(&ftable.lock);
+    return;
   }
+  free_pg->state = P_USED;
+  free_pg->offset = 0;
+  free_pg->virtual_add = add;
+  free_pg->proc = p;
+  free_pg->pte = walk(pagetable, add, 0);
+  free_pg->seq = advice_of(p, add) == MADV_SEQUENTIAL;
+  free_pg->locked = is_locked(p, add);
+  clock_insert(clock_of(p), free_pg); //the newest page goes right behind the hand
+  policy_init(free_pg);
+
+  //link into the owner's resident list
+  free_pg->prev = 0;
+  free_pg->next = p->frames;
+  if(p->frames)
+    p->frames->prev = free_pg;
+  p->frames = free_pg;
+  p->num_of_phys_pages++;
+  release(&ftable.lock);
+}
+
+//unlink a frame table entry from its owner. ftable.lock must be held.
+static void
+clear_frame(struct page *pg)
+{
+  struct proc *p = pg->proc;
+
+  if(pg->prev)
+    pg->prev->next = pg->next;
+  else
+    p->frames = pg->next;
+  if(pg->next)
+    pg->next->prev = pg->prev;
+  p->num_of_phys_pages--;
+  clock_remove(clock_of(p), pg);
+
+  pg->state = P_UNUSED;
+  pg->seq = 0;
+  pg->locked = 0;
+  pg->offset = 0;
+  pg->cached = 0;
+  pg->pte = 0;
+  pg->counter = 0;
+  pg->virtual_add = 0;
+  pg->proc = 0;
+  pg->next = pg->prev = 0;
 }
 
-//This function is reponsible of freeing 1 page from the page table of the process
+//take all of p's frames out of the frame table as p exits or exec()
+//replaces its image, before the old page table is freed and, at exit,
+//p's slot can be reused. frames still shared copy-on-write go over to
+//another sharer. swap_lock must be held.
 void
-free_one_page()
+drop_frames(struct proc *p)
 {
-  struct page *new_page;
-  struct page *phys_page = select_page(); //choose the page to remove
-  uint idx = MAX_TOTAL_PAGES;
-  
-  //this loop is responsible of finding space under swap_pages
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    if(myproc()->swap_pages[i].state == P_UNUSED) {
-      idx = i;
+  struct page *pg;
+  uint64 va, pa;
+
+  for(;;) {
+    acquire(&ftable.lock);
+    if((pg = p->frames) == 0)
       break;
-    }
+    va = pg->virtual_add;
+    pa = FRAME2PA(pg);
+    clear_frame(pg);
+    release(&ftable.lock);
+    if(krefcnt((void*)pa) > 1)
+      retrack(p->pagetable, va, pa);
   }
-  
-  if(idx == MAX_TOTAL_PAGES) { //sanity check
-    panic("No free space was found under swap_pages array");
+  release(&ftable.lock);
+}
+
+//drop frame pa from the frame table, if it is tracked at va for the
+//process whose page table is pagetable. if the frame is still shared copy-on-write, another
+//sharer takes it over. swap_lock must be held if it is tracked.
+void
+remove_page_from_phys_mem(pagetable_t pagetable, uint64 va, uint64 pa)
+{
+  struct page *pg;
+  int shared = 0;
+
+  acquire(&ftable.lock);
+  pg = PA2FRAME(pa);
+  if(pg->state == P_USED && pg->proc->pagetable == pagetable && pg->virtual_add == va) {
+    if(pg->cached)
+      swapdiscard(pg->proc, pg->offset);
+    clear_frame(pg);
+    shared = krefcnt((void*)pa) > 1;
+  }
+  release(&ftable.lock);
+  if(shared)
+    retrack(pagetable, va, pa);
+}
+
+//frame pa at va stopped being tracked for pagetable, but another process
+//still maps it copy-on-write. processes sharing a frame since fork map it
+//at the same address, so look for one there and track the frame for it:
+//otherwise no resident limit would count the frame, and once its last
+//sharer has it alone nothing could page it out. a tracked process only
+//changes or frees its page table under swap_lock, which must be held.
+static void
+retrack(pagetable_t pagetable, uint64 va, uint64 pa)
+{
+  struct proc *q;
+  pte_t *pte;
+  int found;
+
+  for(q = proc; q < &proc[NPROC]; q++) {
+    acquire(&q->lock);
+    found = q->pid > 2 && q->pagetable != 0 && q->pagetable != pagetable &&
+            (q->state == RUNNABLE || q->state == RUNNING || q->state == SLEEPING) &&
+            (pte = walk(q->pagetable, va, 0)) != 0 &&
+            (*pte & PTE_V) && PTE2PA(*pte) == pa && megapte(q->pagetable, va) == 0;
+    release(&q->lock);
+    if(found) {
+      add_page_to_phys_mem(q, q->pagetable, va, pa);
+      return;
+    }
   }
+}
 
-  new_page = &myproc()->swap_pages[idx]; //pointing to the selected free space under swap_array
-  new_page->virtual_add = phys_page->virtual_add; //point to the address you want to delete
-  new_page->counter = phys_page->counter;
-  new_page->offset = idx*PGSIZE;
-  new_page->c_time = 0;
-  new_page->state = P_USED;
+//frame pa, just swapped in, keeps its copy at offset off of the owner's swap space.
+static void
+cache_frame(uint64 pa, uint off)
+{
+  struct page *pg;
 
-  uint64 pa = walkaddr(myproc()->pagetable, PGROUNDDOWN(phys_page->virtual_add));
-//  int success = writeToSwapFile(myproc(), (char*)PTE2PA(phys_page->virtual_add), idx*PGSIZE, PGSIZE); //write to swap_file from physical address
-  int success = writeToSwapFile(myproc(), (char*)pa, idx*PGSIZE, PGSIZE); //write to swap_file from physical address
+  acquire(&ftable.lock);
+  pg = PA2FRAME(pa);
+  pg->cached = 1;
+  pg->offset = off;
+  release(&ftable.lock);
+}
 
-  if(success < 0) { //sanity check
-    panic("failure during writing to swap file");
+//release the swap copies p's resident pages still keep, before its swap space goes away.
+void
+drop_swap_cache(struct proc *p)
+{
+  struct page *pg;
+
+  acquire(&ftable.lock);
+  for(pg = p->frames; pg != 0; pg = pg->next) {
+    if(pg->cached) {
+      swapdiscard(p, pg->offset);
+      pg->cached = 0;
+      pg->offset = 0;
+    }
   }
+  release(&ftable.lock);
+}
 
-  myproc()->num_of_phys_pages--;
-  myproc()->num_of_swap_pages++;
+//track every resident user page of p's current image, e.g. after fork or
+//exec built it. under LOCAL_RECLAIM the extra pages are evicted right away.
+//swap_lock must be held.
+void
+add_all_pages_to_phys_mem(struct proc *p)
+{
+  pte_t *pte;
+  uint64 a;
 
-  //Task2
-//  char* v =(char*) walk(myproc()->pagetable, PGROUNDDOWN(phys_page->virtual_add),0);
-//  kfree(v);
-    kfree((void*)pa);
+  for(a = 0; a < p->sz; a += PGSIZE) {
+    if(megapte(p->pagetable, a)) { //megapages aren't replaced
+      a += MEGASIZE - PGSIZE;
+      continue;
+    }
+    if((pte = walk(p->pagetable, a, 0)) == 0)
+      continue;
+    if((*pte & PTE_V) && (*pte & PTE_U))
+      add_page_to_phys_mem(p, p->pagetable, a, PTE2PA(*pte));
+  }
 
-  pte_t* p_table_entry = walk(myproc()->pagetable, phys_page->virtual_add, 0); //extract PTE from virtual address for the process' page-table
-  *p_table_entry = *p_table_entry | PTE_U | PTE_PG;  //set user bit and PG bit on
-  *p_table_entry = *p_table_entry & ~PTE_V;          //set valid bit off
+  #ifndef GLOBAL_RECLAIM
+    while(p->num_of_phys_pages > MAX_PSYC_PAGES) {
+      if(free_one_page(p) < 0)
+        break;
+    }
+  #endif
+}
 
-  phys_page->state = P_UNUSED;
-  phys_page->offset = 0;
-  phys_page->c_time = 0;
-  phys_page->virtual_add = 0;
-  phys_page->table = 0;
+//can pg be paged out to make room for p? under GLOBAL_RECLAIM any tracked
+//page qualifies as long as its owner isn't running on another CPU, otherwise
+//only p's own pages do. the owner also needs swap space, unless the page
+//has a copy there already, and a frame still shared copy-on-write or
+//mlock()ed can't go.
+int
+can_evict(struct page *pg, struct proc *p)
+{
+  struct proc *owner = pg->proc;
 
-  //TODO kfree on physical page VA?
-  
-  sfence_vma(); //TODO right place? should be between user<->kernel spaces
+  if(pg->state != P_USED || pg->locked || (!pg->cached && swapfull(owner)))
+    return 0;
+  if(krefcnt((void*)FRAME2PA(pg)) > 1) //still shared copy-on-write
+    return 0;
+  if(owner == p)
+    return 1;
+  #ifdef GLOBAL_RECLAIM
+    return owner->state == RUNNABLE || owner->state == SLEEPING;
+  #else
+    return 0;
+  #endif
 }
 
+//the frames a selection for p walks over: the whole frame table under
+//GLOBAL_RECLAIM, p's own resident list otherwise.
 struct page*
-select_page(void)
-{
-  #if NFUA
-    return NFUA_page_selection();
-  #elif LAPA
-    return LAPA_page_selection();
-  #elif SCFIFO
-    return SCFIFO_page_selection();
+first_frame(struct proc *p)
+{
+  #ifdef GLOBAL_RECLAIM
+    return &ftable.frames[0];
+  #else
+    return p->frames;
   #endif
-
-  return 0;
 }
 
 struct page*
-NFUA_page_selection(void)
+next_frame(struct page *pg)
 {
-  int idx = 0;
-  struct page *pg;
-  struct proc *curr_proc = myproc();
-  uint min_val = 0xFFFFFFFF;
-  
-  // get the minimum counter of all physical pages
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    if(curr_proc->phys_pages[i].state == P_USED) {
-      if(curr_proc->phys_pages[i].counter < min_val) {
-        min_val = curr_proc->phys_pages[i].counter;
-        idx = i;
+  #ifdef GLOBAL_RECLAIM
+    pg++;
+    return pg < &ftable.frames[NFRAME] ? pg : 0;
+  #else
+    return pg->next;
+  #endif
+}
+
+//pick a victim for p with the selection policy and lock it: on success
+//ftable.lock is held, and so is the owner's lock if that isn't the current
+//process. returns 0 if nothing can be evicted.
+static struct page*
+lock_victim(struct proc *p)
+{
+  struct page *phys_page;
+  struct proc *owner;
+  uint64 va;
+
+  for(;;) {
+    acquire(&ftable.lock);
+    phys_page = select_page(p); //choose the page to remove
+    if(phys_page == 0) {
+      release(&ftable.lock);
+      return 0;
+    }
+    owner = phys_page->proc;
+    va = phys_page->virtual_add;
+    release(&ftable.lock);
+
+    //lock the owner, then make sure the frame didn't change meanwhile
+    if(owner != myproc())
+      acquire(&owner->lock);
+    acquire(&ftable.lock);
+    if(phys_page->proc == owner && phys_page->virtual_add == va &&
+       can_evict(phys_page, p))
+      return phys_page;
+    release(&ftable.lock);
+    if(owner != myproc())
+      release(&owner->lock);
+  }
+}
+
+//This function is reponsible of paging out up to n pages, chosen by the
+//selection policy, to make room for p. a victim's owner can't run while
+//its PTE is switched to paged-out, so the page contents are stable while
+//written. with a raw swap area the pages go to consecutive slots and are
+//written in one request. a page of zeros is only recorded as such, and a
+//page that wasn't written since it was swapped in reuses its swap copy.
+//swap_lock must be held. returns the number of pages paged out.
+int
+free_pages(struct proc *p, int n)
+{
+  struct page *phys_page;
+  struct proc *owner, *owners[SWAPCLUSTER];
+  uint64 pa, t, pas[SWAPCLUSTER], kpas[SWAPCLUSTER];
+  uint off, offs[SWAPCLUSTER];
+  pte_t *p_table_entry;
+  int i, got, clean, zero, nio = 0, nkeep = 0, slot = 0;
+
+  if(!holdingsleep(&swap_lock))
+    panic("free_pages: swap_lock");
+  if(n > SWAPCLUSTER)
+    n = SWAPCLUSTER;
+
+  //with a raw swap area the pages go to a run of slots on the swap disk
+  if(rawswap()) {
+    while(n > 0 && (slot = swapalloc(n)) < 0)
+      n--;
+  }
+
+  for(got = 0; got < n; got++) {
+    if((phys_page = lock_victim(p)) == 0)
+      break;
+    owner = phys_page->proc;
+
+    pa = FRAME2PA(phys_page);
+    p_table_entry = phys_page->pte; //the PTE of the owner's page-table that maps it
+
+    //the swap copy of a page written since it came in is stale
+    clean = phys_page->cached && (*p_table_entry & PTE_D) == 0;
+    if(phys_page->cached && !clean)
+      swapdiscard(owner, phys_page->offset);
+
+    zero = !clean && is_zero_page(pa);
+    off = 0;
+    if(clean)
+      off = phys_page->offset;
+    else if(rawswap() && !zero)
+      off = slot + nio*PGSIZE;
+    else if(!zero && (int)(off = swapget(owner)) < 0)
+      panic("free_pages: swap file full");
+    owner->num_of_swap_pages++;
+
+    policy_evicted(phys_page);
+    pgstat_out(owner, p->policy, !zero && !clean);
+
+    //the PTE keeps the swap offset where the frame was, and the PG bit on
+    //and the valid bit off; a page of zeros has no offset
+    *p_table_entry = (zero ? PTE_Z : SWAP2PTE(off)) | ((PTE_FLAGS(*p_table_entry) | PTE_PG) & ~PTE_V);
+    tlbflush(owner, phys_page->virtual_add, 1);
+
+    clear_frame(phys_page);
+    release(&ftable.lock);
+    if(owner != myproc())
+      release(&owner->lock);
+
+    if(zero || clean) {
+      kpas[nkeep++] = pa; //nothing to write
+    } else {
+      owners[nio] = owner;
+      offs[nio] = off;
+      pas[nio++] = pa;
+    }
+  }
+
+  t = r_time();
+  if(rawswap()) {
+    for(i = nio; i < n; i++)
+      swapfree(slot + i*PGSIZE);
+    if(nio > 0)
+      swapwritev(slot, pas, nio);
+  } else {
+    for(i = 0; i < nio; i++) {
+      if(swapwrite(owners[i], (char*)pas[i], offs[i], PGSIZE) < 0) { //sanity check
+        panic("failure during writing to swap space");
       }
     }
   }
+  if(nio > 0)
+    pgstat_lat(myproc(), 1, r_time() - t);
+  for(i = 0; i < nio; i++)
+    kfree((void*)pas[i]);
+  for(i = 0; i < nkeep; i++)
+    kfree((void*)kpas[i]);
+
+  return got;
+}
 
-  pg = &curr_proc->phys_pages[idx]; //select the page
-  pg->counter = 0; //reset counter
-  return pg;
+//page out one page to make room for p. swap_lock must be held.
+//returns 0 on success, -1 if nothing can be evicted.
+int
+free_one_page(struct proc *p)
+{
+  return free_pages(p, 1) == 1 ? 0 : -1;
 }
 
-struct page*
-LAPA_page_selection(void)
+//switch p to replacement policy policy. its resident pages start over
+//as if they had just come in. p->lock must be held.
+void
+set_policy(struct proc *p, int policy)
 {
-  int idx = 0;
   struct page *pg;
-  struct proc *curr_proc = myproc();
-  uint min_counter_val = 0xFFFFFFFF;
-  uint min_by_ones = 31;
-  int val;
-  
-  // get the minimum counter of all physical pages
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    if(curr_proc->phys_pages[i].state == P_USED) {
-      val = one_bits_counter(curr_proc->phys_pages[i].counter);
-      if(val < min_by_ones) {
-        min_by_ones = val;
-        min_counter_val = curr_proc->phys_pages[i].counter;
-        idx = i;
-      } else if(val == min_by_ones) {
-        if(curr_proc->phys_pages[i].counter < min_counter_val) {
-          min_counter_val = curr_proc->phys_pages[i].counter;
-          idx = i;
-        }
-      }
+
+  acquire(&ftable.lock);
+  p->policy = policy;
+  for(pg = p->frames; pg != 0; pg = pg->next)
+    policy_init(pg);
+  release(&ftable.lock);
+}
+
+//the advice p was given for its page at va, MADV_NORMAL if none.
+int
+advice_of(struct proc *p, uint64 va)
+{
+  struct advice *a;
+
+  for(a = &p->advice[p->nadvice - 1]; a >= p->advice; a--) {
+    if(va >= a->va && va < a->end)
+      return a->advice;
+  }
+  return MADV_NORMAL;
+}
+
+//remember advice for [va, end) of p. it hides what it overlaps, and
+//replaces what it covers; the oldest range makes room if need be.
+static void
+set_advice(struct proc *p, uint64 va, uint64 end, int advice)
+{
+  int i, j;
+
+  for(i = j = 0; i < p->nadvice; i++) {
+    if(p->advice[i].va < va || p->advice[i].end > end)
+      p->advice[j++] = p->advice[i];
+  }
+  p->nadvice = j;
+  if(advice == MADV_NORMAL && p->nadvice == 0)
+    return;
+  if(p->nadvice == NADVICE) {
+    memmove(p->advice, p->advice + 1, (NADVICE-1) * sizeof(struct advice));
+    p->nadvice--;
+  }
+  p->advice[p->nadvice].va = va;
+  p->advice[p->nadvice].end = end;
+  p->advice[p->nadvice].advice = advice;
+  p->nadvice++;
+}
+
+//Task 1 - tell how [va, va+len) of the current process will be used,
+//with MADV_* in policy.h. RANDOM and SEQUENTIAL are remembered for
+//read-ahead and eviction until other advice covers the range. WILLNEED
+//swaps the paged-out pages of the range in, as far as that pages
+//nothing else out. DONTNEED throws the pages away without writing them:
+//they come back zero, or from the executable. returns 0, or -1 if the
+//range or the advice is bad, or DONTNEED would drop mlock()ed pages.
+int
+madvise(uint64 va, uint64 len, int advice)
+{
+  struct proc *p = myproc();
+  struct page *pg;
+  uint64 a, end;
+  pte_t *pte;
+  int paging = 0;
+
+  end = PGROUNDUP(va + len);
+  if(va % PGSIZE || end < va || end > p->sz || advice < 0 || advice > MADV_DONTNEED)
+    return -1;
+  if(advice == MADV_DONTNEED && locked_pages(p, va, end) > 0)
+    return -1;
+
+  #ifndef NONE
+    paging = p->pid > 2;
+  #endif
+  if(paging)
+    acquiresleep(&swap_lock);
+
+  switch(advice) {
+  case MADV_NORMAL:
+  case MADV_RANDOM:
+  case MADV_SEQUENTIAL:
+    set_advice(p, va, end, advice);
+    acquire(&ftable.lock);
+    for(pg = p->frames; pg != 0; pg = pg->next) {
+      if(pg->virtual_add >= va && pg->virtual_add < end)
+        policy_seq(pg, advice == MADV_SEQUENTIAL);
     }
+    release(&ftable.lock);
+    break;
+
+  case MADV_WILLNEED:
+    for(a = va; paging && a < end && readahead_room(p) > 0; a += PGSIZE) {
+      pte = walk(p->pagetable, a, 0);
+      if(pte && is_paged_out(pte))
+        handle_page_out(a, pte, 0);
+    }
+    break;
+
+  case MADV_DONTNEED:
+    for(a = va; a < end; a += PGSIZE) {
+      pte = walk(p->pagetable, a, 0);
+      if(pte && (*pte & PTE_U)) //the stack guard page stays
+        uvmunmap(p->pagetable, a, 1, 1);
+    }
+    break;
   }
 
-  pg = &curr_proc->phys_pages[idx]; //select the page
-  pg->counter = 0xFFFFFFFF; //reset counter
-  return pg;
+  if(paging)
+    releasesleep(&swap_lock);
+  return 0;
 }
 
-//count the number of bits of "1" for the counter inserted. Necessary for LAPA page selection
+//is the page at va of p in one of its mlock()ed ranges?
 int
-one_bits_counter(uint counter) 
+is_locked(struct proc *p, uint64 va)
 {
-  uint new_counter = 0;
-  while(counter) {
-    new_counter += counter & 1; //if the LSB is 1 add to counter, otherwise - don't add
-    counter = counter >> 1; // trim the LSB
+  struct lockrange *l;
+
+  for(l = p->locks; l < &p->locks[p->nlocks]; l++) {
+    if(va >= l->va && va < l->end)
+      return 1;
   }
+  return 0;
+}
 
-  return new_counter;
+//the pages of [va, end) in p's mlock()ed ranges
+static int
+locked_pages(struct proc *p, uint64 va, uint64 end)
+{
+  struct lockrange *l;
+  uint64 s, e;
+  int n = 0;
+
+  for(l = p->locks; l < &p->locks[p->nlocks]; l++) {
+    s = l->va > va ? l->va : va;
+    e = l->end < end ? l->end : end;
+    if(s < e)
+      n += (e - s) / PGSIZE;
+  }
+  return n;
 }
 
-struct page*
-SCFIFO_page_selection(void)
-{
-  struct page *pg = 0;
-  struct proc *curr_proc = myproc();
-  int min_creation_val;
-
-  while(1) {
-    min_creation_val = time + 1;
-    for(int i=0; i<MAX_PSYC_PAGES; i++) {
-        pte_t *my_pte = walk(curr_proc->pagetable, curr_proc->phys_pages[i].virtual_add, 0);
-        if((curr_proc->phys_pages[i].state == P_USED) && (*my_pte & PTE_U)) {
-            if(curr_proc->phys_pages[i].c_time < min_creation_val) {
-              pg = &curr_proc->phys_pages[i];
-              min_creation_val = pg->c_time;
-            }
-        }
+//pin or unpin the resident frames of p in [va, end), as its ranges say.
+static void
+pin_frames(struct proc *p, uint64 va, uint64 end)
+{
+  struct page *pg;
+
+  acquire(&ftable.lock);
+  for(pg = p->frames; pg != 0; pg = pg->next) {
+    if(pg->virtual_add >= va && pg->virtual_add < end)
+      pg->locked = is_locked(p, pg->virtual_add);
+  }
+  release(&ftable.lock);
+}
+
+//take [va, end) out of p's mlock()ed ranges. returns -1 if a range
+//would split in two and there is no room for the second half.
+int
+unlock_range(struct proc *p, uint64 va, uint64 end)
+{
+  struct lockrange *l;
+  int i;
+
+  for(i = 0; i < p->nlocks; ) {
+    l = &p->locks[i];
+    if(l->end <= va || l->va >= end) {
+      i++;
+    } else if(l->va < va && l->end > end) {
+      //the ranges are apart, so no other one overlaps
+      if(p->nlocks == NLOCKS)
+        return -1;
+      p->locks[p->nlocks].va = end;
+      p->locks[p->nlocks].end = l->end;
+      p->nlocks++;
+      l->end = va;
+      i++;
+    } else if(l->va < va) {
+      l->end = va;
+      i++;
+    } else if(l->end > end) {
+      l->va = end;
+      i++;
+    } else {
+      *l = p->locks[--p->nlocks];
     }
+  }
+  p->nlocked = locked_pages(p, 0, MAXVA);
+  pin_frames(p, va, end);
+  return 0;
+}
 
-    pte_t *pte = walk(curr_proc->pagetable, pg->virtual_add, 0); //get the entry of the physical page we want to remove
-    if((*pte & PTE_A) > 0) {
-      *pte = *pte & ~PTE_A; //turn off access bit and give another chance later before selection
-      pg->c_time = ++time; //update creation time so that this page will go to the end of the FIFO until next round
+//Task 1 - pin [va, va+len) of the current process in memory: its pages
+//are brought in now and no policy evicts them until munlock(). at most
+//MAX_LOCKED_PAGES pages stay locked. returns 0, or -1 if the range is
+//bad, over the limit, or couldn't be brought in.
+int
+mlock(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  struct lockrange *l, old[NLOCKS];
+  uint64 a, s, end;
+  int i, merge, nold;
+
+  end = PGROUNDUP(va + len);
+  if(va % PGSIZE || end < va || end > p->sz)
+    return -1;
+  for(merge = 0, l = p->locks; l < &p->locks[p->nlocks]; l++) {
+    if(l->end >= va && l->va <= end)
+      merge = 1;
+  }
+  if((!merge && p->nlocks == NLOCKS) ||
+     p->nlocked + (end - va) / PGSIZE - locked_pages(p, va, end) > MAX_LOCKED_PAGES) {
+    pgstat_lockfail(p);
+    return -1;
+  }
+
+  //the new range takes in the ones it overlaps or touches
+  memmove(old, p->locks, sizeof(old));
+  nold = p->nlocks;
+  s = va;
+  a = end;
+  for(i = 0; i < p->nlocks; ) {
+    l = &p->locks[i];
+    if(l->end >= s && l->va <= a) {
+      s = l->va < s ? l->va : s;
+      a = l->end > a ? l->end : a;
+      *l = p->locks[--p->nlocks];
     } else {
-      pg->c_time = 0;
-      return pg;
+      i++;
     }
   }
+  p->locks[p->nlocks].va = s;
+  p->locks[p->nlocks].end = a;
+  p->nlocks++;
+  p->nlocked = locked_pages(p, 0, MAXVA);
+  pin_frames(p, va, end);
+
+  //bring the pages in. the ones that come in are pinned as they do
+  for(a = va; a < end; a += PGSIZE) {
+    if(uvmfault(p, a, 0) < 0) {
+      //out of memory: the ranges are as they were, and so are the pins
+      memmove(p->locks, old, sizeof(old));
+      p->nlocks = nold;
+      p->nlocked = locked_pages(p, 0, MAXVA);
+      pin_frames(p, va, end);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//Task 1 - unpin [va, va+len) of the current process. returns 0, or -1
+//if the range is bad or would leave too many locked ranges.
+int
+munlock(uint64 va, uint64 len)
+{
+  struct proc *p = myproc();
+  uint64 end;
+
+  end = PGROUNDUP(va + len);
+  if(va % PGSIZE || end < va || end > p->sz)
+    return -1;
+  return unlock_range(p, va, end);
 }
 
+//age the resident pages of p if its policy keeps counters (NFUA, LAPA):
+//every counter shifts right, taking the accessed bit as its MSB. with
+//tracing on, the pages found accessed are also recorded, whatever the
+//policy; a clock policy then finds the bit in pg->ref. runs on the timer
+//interrupt of the CPU p runs on, at most once every AGETICKS ticks. the
+//accessed bits are taken straight from the leaf page-table pages, and
+//cleared with one TLB flush at the end so that the hardware sets them again.
 void
-NFUA_LAPA_handler(void)
+age_pages(struct proc *p)
 {
-  uint num = 1 << 31;
-  pte_t *pte = 0;
-  struct proc *curr_proc = myproc();
-  
-  //go over all physical pages and check for access bit. Turn it off after increase the MSB
-  for(int i=0; i<MAX_PSYC_PAGES; i++) {
-    if(curr_proc->phys_pages[i].state == P_USED) {
-      curr_proc->phys_pages[i].counter = curr_proc->phys_pages[i].counter >> 1; //trim the LSB
-      pte = walk(curr_proc->pagetable, (uint64)curr_proc->phys_pages[i].virtual_add, 0);
-      if((*pte & PTE_A) > 0) { //access bit is on
-        curr_proc->phys_pages[i].counter = curr_proc->phys_pages[i].counter | num; //turn on the MSB
-        *pte = (*pte & ~PTE_A); //turn off access bit
+  pagetable_t l1, l0;
+  pte_t *pte;
+  struct page *pg;
+  uint64 pa;
+  int i, j, k, aging, accessed, flush = 0;
+
+  aging = policy_aging(p);
+  if(!aging && !tracing)
+    return;
+  if(ticks - p->agetick < AGETICKS || p->num_of_phys_pages == 0)
+    return;
+  p->agetick = ticks;
+
+  acquire(&ftable.lock);
+  for(i = 0; i < 512; i++) {
+    if((p->pagetable[i] & PTE_V) == 0 || (p->pagetable[i] & (PTE_R|PTE_W|PTE_X)))
+      continue;
+    l1 = (pagetable_t)PTE2PA(p->pagetable[i]);
+    for(j = 0; j < 512; j++) {
+      if((l1[j] & PTE_V) == 0 || (l1[j] & (PTE_R|PTE_W|PTE_X)))
+        continue;
+      l0 = (pagetable_t)PTE2PA(l1[j]);
+      for(k = 0; k < 512; k++) {
+        pte = &l0[k];
+        if((*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+          continue;
+        pa = PTE2PA(*pte);
+        if(pa < KERNBASE || pa >= PHYSTOP)
+          continue;
+        pg = PA2FRAME(pa);
+        if(pg->state != P_USED || pg->pte != pte) //not tracked, or tracked for another mapping
+          continue;
+        accessed = (*pte & PTE_A) > 0;
+        if(aging)
+          policy_age(pg, accessed);
+        if(accessed) {
+          if(!aging)
+            pg->ref = 1;
+          trace_event(TR_ACCESS, p->pid, pg->virtual_add, (*pte & PTE_D) != 0);
+          *pte = (*pte & ~PTE_A); //turn off access bit
+          flush = 1;
+        }
       }
     }
   }
+  trace_event(TR_AGE, p->pid, 0, 0);
+  release(&ftable.lock);
+
+  if(flush)
+    tlbflush(p, 0, 0);
 }
 
+//release the swap space of the paged-out page of the current process that
+//pte maps, if pagetable is its page table. swap_lock must be held.
 void
-remove_page_from_memo(pte_t *pte, uint add, struct page *arr)
-{
-    struct page* p;
-    for(int i=0; i<MAX_PSYC_PAGES; i++) {
-        if((arr[i].virtual_add == add) && (arr[i].state == P_USED)) { //find the physical page matches the virtual address nad reset its' values
-            p = &(arr[i]);
-            p->counter = 0;
-            p->table = 0;
-            p->virtual_add = 0;
-            p->c_time = 0;
-            p->state = P_UNUSED;
-            p->offset = 0;
-            #if LAPA
-                p->counter = 0xFFFFFFFF;
-            #endif
-            break;
-        }
-    }
-}
\ No newline at end of file
+remove_swap_page(pagetable_t pagetable, pte_t *pte)
+{
+  struct proc *p = myproc();
+
+  if(p == 0 || pagetable != p->pagetable || !is_paged_out(pte))
+    return;
+  if((*pte & PTE_Z) == 0)
+    swapdiscard(p, PTE2SWAP(*pte));
+  p->num_of_swap_pages--;
+}
+
+//the first paged-out PTE of pagetable at or after *va and below sz, with
+//*va moved to its page, or 0 if there is none. 2MB blocks without a page
+//table page are skipped whole.
+pte_t*
+next_swap_page(pagetable_t pagetable, uint64 *va, uint64 sz)
+{
+  pte_t *pte;
+
+  for(; *va < sz; *va += PGSIZE) {
+    if((pte = walk(pagetable, *va, 0)) == 0)
+      *va = MEGAROUNDDOWN(*va) + MEGASIZE - PGSIZE;
+    else if(is_paged_out(pte))
+      return pte;
+  }
+  return 0;
+}
+
+//release the swap space of every paged-out page of p below sz in pagetable,
+//p's page table or the one exec() is replacing, and clear their PTEs.
+//swap_lock must be held.
+void
+free_swap_pages(struct proc *p, pagetable_t pagetable, uint64 sz)
+{
+  pte_t *pte;
+  uint64 a;
+
+  for(a = 0; (pte = next_swap_page(pagetable, &a, sz)) != 0; a += PGSIZE) {
+    if((*pte & PTE_Z) == 0)
+      swapdiscard(p, PTE2SWAP(*pte));
+    *pte = 0;
+    p->num_of_swap_pages--;
+  }
+}
@@ -0,0 +1,347 @@
+// Compressed swap pool.
+//
+// A page being swapped out is first compressed into an arena of
+// kernel memory, and only reaches the swap disk or swap file when
+// the arena is full: the oldest compressed pages are then spilled
+// to their place in swap space to make room. Swapping a page in
+// from the arena is a decompression instead of a disk read.
+//
+// Pages are keyed by where they live in swap space: the slot's
+// offset in the raw swap area, or the owning process and offset in
+// its swap file. An entry stays until the swap space is released,
+// since a raw slot can be shared by a parent and child after fork.
+//
+// The compressor is a small LZ77 in the style of LZ4: a sequence is
+// a token byte with the literal length in the high nibble and the
+// match length - 4 in the low nibble (15 means more length bytes
+// follow), the literals, and a 2-byte match offset. The last
+// sequence has literals only.
+//
+// Storing and reading pages runs under swap_lock. zpool.lock guards
+// the entries and the arena, since a swap-cached page's copy can be
+// dropped without swap_lock when a copy-on-write fault unmaps it.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define ZUNIT     64                  // arena allocation unit, in bytes
+#define NZUNIT    (ZPOOLSIZE / ZUNIT)
+#define NZENT     (ZPOOLSIZE / 512)   // entries, for pages compressing up to 8x
+#define ZMAXLEN   (PGSIZE * 3 / 4)    // pages that don't compress below this go to disk
+#define ZHASHBITS 10
+
+struct zent {
+  int used;
+  struct proc *p;         // owner of the swap file, 0 for the raw swap area
+  uint off;               // offset of the page in swap space
+  ushort unit;            // first arena unit of the compressed page
+  ushort len;             // compressed length in bytes
+  uint seq;               // age: the oldest is spilled first
+};
+
+struct {
+  struct spinlock lock;
+  char arena[ZPOOLSIZE];
+  uchar map[NZUNIT];      // is the unit in use?
+  struct zent ent[NZENT];
+  uint seq;
+  struct zpoolstat stat;
+
+  // scratch space, protected by swap_lock.
+  ushort hash[1 << ZHASHBITS];
+  uchar cbuf[ZMAXLEN];
+  char spill[PGSIZE] __attribute__((aligned (PGSIZE)));
+} zpool;
+
+static uint
+zhashof(const uchar *p)
+{
+  uint v = p[0] | p[1] << 8 | p[2] << 16 | (uint)p[3] << 24;
+  return (v * 2654435761U) >> (32 - ZHASHBITS);
+}
+
+// append a length of 15 or more as LZ4 does: bytes of 255, then the rest.
+static uchar*
+zputlen(uchar *op, int len)
+{
+  for(len -= 15; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+// compress n bytes at src into dst. returns the compressed
+// length, or 0 if it would exceed cap.
+static int
+zcompress(const uchar *src, int n, uchar *dst, int cap)
+{
+  const uchar *ip = src, *anchor = src, *end = src + n, *ref, *m, *r;
+  uchar *op = dst, *oend = dst + cap, *token;
+  int lit, mlen, off;
+  uint h;
+
+  memset(zpool.hash, 0, sizeof(zpool.hash));
+  while(ip + 4 <= end){
+    h = zhashof(ip);
+    ref = src + zpool.hash[h];
+    zpool.hash[h] = ip - src;
+    if(ref >= ip || ip - ref > 0xffff ||
+       ref[0] != ip[0] || ref[1] != ip[1] || ref[2] != ip[2] || ref[3] != ip[3]){
+      ip++;
+      continue;
+    }
+    for(m = ip + 4, r = ref + 4; m < end && *m == *r; m++, r++)
+      ;
+    lit = ip - anchor;
+    mlen = m - ip - 4;
+    if(op + 1 + lit + lit/255 + 1 + 2 + mlen/255 + 1 > oend)
+      return 0;
+    token = op++;
+    *token = (lit < 15 ? lit : 15) << 4 | (mlen < 15 ? mlen : 15);
+    if(lit >= 15)
+      op = zputlen(op, lit);
+    memmove(op, anchor, lit);
+    op += lit;
+    off = ip - ref;
+    *op++ = off & 0xff;
+    *op++ = off >> 8;
+    if(mlen >= 15)
+      op = zputlen(op, mlen);
+    ip = anchor = m;
+  }
+
+  lit = end - anchor;
+  if(op + 1 + lit + lit/255 + 1 > oend)
+    return 0;
+  token = op++;
+  *token = (lit < 15 ? lit : 15) << 4;
+  if(lit >= 15)
+    op = zputlen(op, lit);
+  memmove(op, anchor, lit);
+  op += lit;
+  return op - dst;
+}
+
+// decompress n bytes at src into dst, which holds dn bytes.
+// returns the decompressed length, or -1 if src is corrupt.
+static int
+zdecompress(const uchar *src, int n, uchar *dst, int dn)
+{
+  const uchar *ip = src, *iend = src + n;
+  uchar *op = dst, *oend = dst + dn, *ref;
+  int len, off, b;
+
+  while(ip < iend){
+    uint token = *ip++;
+    len = token >> 4;
+    if(len == 15){
+      do {
+        if(ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while(b == 255);
+    }
+    if(ip + len > iend || op + len > oend)
+      return -1;
+    memmove(op, ip, len);
+    op += len;
+    ip += len;
+    if(ip >= iend)
+      break;  // the last sequence has no match
+
+    if(ip + 2 > iend)
+      return -1;
+    off = ip[0] | ip[1] << 8;
+    ip += 2;
+    if(off == 0 || off > op - dst)
+      return -1;
+    len = token & 15;
+    if(len == 15){
+      do {
+        if(ip >= iend)
+          return -1;
+        b = *ip++;
+        len += b;
+      } while(b == 255);
+    }
+    len += 4;
+    if(op + len > oend)
+      return -1;
+    for(ref = op - off; len > 0; len--)
+      *op++ = *ref++;  // may overlap
+  }
+  return op - dst;
+}
+
+void
+zpoolinit(void)
+{
+  initlock(&zpool.lock, "zpool");
+}
+
+static struct zent*
+zlookup(struct proc *p, uint off)
+{
+  struct zent *e;
+
+  for(e = zpool.ent; e < &zpool.ent[NZENT]; e++){
+    if(e->used && e->p == p && e->off == off)
+      return e;
+  }
+  return 0;
+}
+
+// allocate n consecutive arena units. returns the first, or -1.
+static int
+zalloc(int n)
+{
+  int i, j;
+
+  for(i = 0; i + n <= NZUNIT; i = j + 1){
+    for(j = i; j < i + n && zpool.map[j] == 0; j++)
+      ;
+    if(j == i + n){
+      memset(&zpool.map[i], 1, n);
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void
+zrelease(struct zent *e)
+{
+  memset(&zpool.map[e->unit], 0, (e->len + ZUNIT - 1) / ZUNIT);
+  e->used = 0;
+}
+
+// write the oldest page out to its place in swap space.
+// returns -1 if the pool is empty. zpool.lock must not be held;
+// the entry is gone before the write, but nothing can look for it
+// until swap_lock is released.
+static int
+zspill(void)
+{
+  struct zent *e, *old = 0;
+  struct proc *p;
+  uint64 pa;
+  uint off;
+
+  acquire(&zpool.lock);
+  for(e = zpool.ent; e < &zpool.ent[NZENT]; e++){
+    if(e->used && (old == 0 || e->seq < old->seq))
+      old = e;
+  }
+  if(old == 0){
+    release(&zpool.lock);
+    return -1;
+  }
+  if(zdecompress((uchar*)&zpool.arena[old->unit * ZUNIT], old->len,
+                 (uchar*)zpool.spill, PGSIZE) != PGSIZE)
+    panic("zspill: corrupt");
+  p = old->p;
+  off = old->off;
+  zrelease(old);
+  zpool.stat.spills++;
+  release(&zpool.lock);
+
+  if(p == 0){
+    pa = (uint64)zpool.spill;
+    virtio_swap_rw(off / 512, &pa, 1, 1);
+  } else if(writeToSwapFile(p, zpool.spill, off, PGSIZE) < 0){
+    panic("zspill: write");
+  }
+  return 0;
+}
+
+// try to keep the page at buf, which belongs at off of p's swap
+// space, in the pool. p is 0 for the raw swap area.
+// returns 0 if it was stored, -1 if it has to go to disk.
+int
+zpool_put(struct proc *p, uint off, char *buf)
+{
+  struct zent *e;
+  int len, unit;
+
+  zpool_drop(p, off);
+
+  len = zcompress((uchar*)buf, PGSIZE, zpool.cbuf, ZMAXLEN);
+  acquire(&zpool.lock);
+  if(len == 0){
+    zpool.stat.rejects++;
+    release(&zpool.lock);
+    return -1;
+  }
+
+  for(;;){
+    for(e = zpool.ent; e < &zpool.ent[NZENT] && e->used; e++)
+      ;
+    if(e < &zpool.ent[NZENT] && (unit = zalloc((len + ZUNIT - 1) / ZUNIT)) >= 0)
+      break;
+    release(&zpool.lock);
+    if(zspill() < 0)
+      return -1;
+    acquire(&zpool.lock);
+  }
+
+  memmove(&zpool.arena[unit * ZUNIT], zpool.cbuf, len);
+  e->used = 1;
+  e->p = p;
+  e->off = off;
+  e->unit = unit;
+  e->len = len;
+  e->seq = ++zpool.seq;
+  zpool.stat.stores++;
+  zpool.stat.inbytes += PGSIZE;
+  zpool.stat.outbytes += len;
+  release(&zpool.lock);
+  return 0;
+}
+
+// fill buf with the page at off of p's swap space if the pool
+// holds it. returns 0 on a hit, -1 if it has to come from disk.
+int
+zpool_get(struct proc *p, uint off, char *buf)
+{
+  struct zent *e;
+
+  acquire(&zpool.lock);
+  if((e = zlookup(p, off)) == 0){
+    zpool.stat.misses++;
+    release(&zpool.lock);
+    return -1;
+  }
+  if(zdecompress((uchar*)&zpool.arena[e->unit * ZUNIT], e->len,
+                 (uchar*)buf, PGSIZE) != PGSIZE)
+    panic("zpool_get: corrupt");
+  zpool.stat.hits++;
+  release(&zpool.lock);
+  return 0;
+}
+
+// forget the page at off of p's swap space, whose swap space
+// was released.
+void
+zpool_drop(struct proc *p, uint off)
+{
+  struct zent *e;
+
+  acquire(&zpool.lock);
+  if((e = zlookup(p, off)) != 0)
+    zrelease(e);
+  release(&zpool.lock);
+}
+
+void
+zpool_stat(struct zpoolstat *st)
+{
+  acquire(&zpool.lock);
+  *st = zpool.stat;
+  release(&zpool.lock);
+}
@@ -0,0 +1,412 @@
+// pgsim: replay page traces against the page replacement policies.
+//
+//   pgsim [-p policy] [-f frames,...] [-r readus] [-w writeus] [trace]
+//
+// The trace is what pgtrace printed, lines of
+//
+//   @ tick pid type va write
+//
+// read from the file or standard input; other lines, like the rest of
+// the console output, are skipped. For every policy (or just -p) and
+// frame budget (-f, default 8,16,32,64) the trace is replayed with
+// kernel/replace.c, the code the kernel runs, and pgsim reports the
+// faults, swap reads and writes, and the time they would stall for at
+// readus and writeus microseconds per page (default 100).
+//
+// The frames are one pool for all processes, as under GLOBAL_RECLAIM.
+// A page that was never paged out comes in without a read, and a page
+// not written since it was read keeps its swap copy, as in the kernel.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/spinlock.h"
+#include "kernel/proc.h"
+#include "kernel/policy.h"
+#include "kernel/trace.h"
+
+// replace.c, as declared in kernel/defs.h
+extern int defpolicy;
+void clock_insert(struct clock*, struct page*);
+void clock_remove(struct clock*, struct page*);
+void ghost_forget(struct proc*);
+void policy_init(struct page*);
+void policy_evicted(struct page*);
+int policy_aging(struct proc*);
+void policy_age(struct page*, int);
+struct page* select_page(struct proc*);
+
+char *names[NPOLICY] = {
+[POLICY_NFUA]      "nfua",
+[POLICY_LAPA]      "lapa",
+[POLICY_SCFIFO]    "scfifo",
+[POLICY_WSCLOCK]   "wsclock",
+[POLICY_CLOCKPRO]  "clockpro",
+[POLICY_ARC]       "arc",
+};
+
+// a page of a traced process, resident or not.
+struct vpage {
+  int pid;
+  uint64 va;
+  int frame;              // -1 if not resident
+  int swapped;            // has a copy in swap space
+  struct vpage *next;     // hash chain
+};
+
+#define NHASH 4096
+
+struct trace *trace;
+int ntrace, maxpid;
+
+struct vpage *vhash[NHASH];
+struct proc **procs;
+struct page *frames;
+pte_t *ptes;
+int nframe;
+struct clock clock;
+uint ticks;
+
+struct {
+  long faults, reads, writes;
+} stat;
+
+// the environment replace.c expects from vm.c.
+struct clock*
+clock_of(struct proc *p)
+{
+  return &clock;
+}
+
+int
+can_evict(struct page *pg, struct proc *p)
+{
+  return pg->state == P_USED;
+}
+
+struct page*
+first_frame(struct proc *p)
+{
+  return &frames[0];
+}
+
+struct page*
+next_frame(struct page *pg)
+{
+  pg++;
+  return pg < &frames[nframe] ? pg : 0;
+}
+
+void
+tlbflush(struct proc *p, uint64 va, uint64 npages)
+{
+}
+
+void
+usage(void)
+{
+  fprintf(stderr, "usage: pgsim [-p policy] [-f frames,...] [-r readus] [-w writeus] [trace]\n");
+  exit(1);
+}
+
+void
+readtrace(FILE *f)
+{
+  char line[256], type;
+  struct trace t;
+  unsigned long long va;
+  int cap = 0;
+
+  while(fgets(line, sizeof(line), f)){
+    if(sscanf(line, "@ %u %d %c %llx %d", &t.tick, &t.pid, &type, &va, &t.write) != 5)
+      continue;
+    if(t.pid < 0)
+      continue;
+    t.va = va;
+    switch(type){
+    case 'F': t.type = TR_FAULT; break;
+    case 'A': t.type = TR_ACCESS; break;
+    case 'G': t.type = TR_AGE; break;
+    case 'X': t.type = TR_EXIT; break;
+    default: continue;
+    }
+    if(ntrace == cap){
+      cap = cap ? 2*cap : 4096;
+      if((trace = realloc(trace, cap * sizeof(*trace))) == 0){
+        perror("pgsim");
+        exit(1);
+      }
+    }
+    trace[ntrace++] = t;
+    if(t.pid > maxpid)
+      maxpid = t.pid;
+  }
+}
+
+struct proc*
+getproc(int pid, int policy)
+{
+  if(procs[pid] == 0){
+    if((procs[pid] = calloc(1, sizeof(struct proc))) == 0){
+      perror("pgsim");
+      exit(1);
+    }
+    procs[pid]->pid = pid;
+    procs[pid]->policy = policy;
+  }
+  return procs[pid];
+}
+
+struct vpage*
+getvpage(int pid, uint64 va)
+{
+  struct vpage **h = &vhash[(va / PGSIZE * 31 + pid) % NHASH], *v;
+
+  for(v = *h; v; v = v->next){
+    if(v->pid == pid && v->va == va)
+      return v;
+  }
+  if((v = calloc(1, sizeof(*v))) == 0){
+    perror("pgsim");
+    exit(1);
+  }
+  v->pid = pid;
+  v->va = va;
+  v->frame = -1;
+  v->next = *h;
+  *h = v;
+  return v;
+}
+
+void
+evict(struct page *pg)
+{
+  struct vpage *v = getvpage(pg->proc->pid, pg->virtual_add);
+
+  policy_evicted(pg);
+  if(!pg->cached || (*pg->pte & PTE_D)){
+    stat.writes++;
+    v->swapped = 1;
+  }
+  clock_remove(&clock, pg);
+  pg->state = P_UNUSED;
+  v->frame = -1;
+}
+
+// pid touched va.
+void
+reference(struct proc *p, uint64 va, int write)
+{
+  struct vpage *v = getvpage(p->pid, va);
+  struct page *pg;
+  int f;
+
+  if(v->frame >= 0){
+    ptes[v->frame] |= PTE_A | (write ? PTE_D : 0);
+    return;
+  }
+
+  stat.faults++;
+  for(f = 0; f < nframe && frames[f].state == P_USED; f++)
+    ;
+  if(f == nframe){
+    if((pg = select_page(p)) == 0)
+      pg = &frames[0];
+    evict(pg);
+    f = pg - frames;
+  }
+
+  pg = &frames[f];
+  memset(pg, 0, sizeof(*pg));
+  pg->state = P_USED;
+  pg->proc = p;
+  pg->virtual_add = va;
+  pg->pte = &ptes[f];
+  ptes[f] = PTE_V | PTE_U | PTE_A | (write ? PTE_D : 0);
+  if(v->swapped){
+    stat.reads++;
+    pg->cached = 1;
+  }
+  v->frame = f;
+  clock_insert(&clock, pg);
+  policy_init(pg);
+}
+
+// the kernel's trace pass over pid's pages, as age_pages() does it.
+void
+age(struct proc *p)
+{
+  struct page *pg;
+  int aging = policy_aging(p), accessed;
+
+  for(pg = frames; pg < &frames[nframe]; pg++){
+    if(pg->state != P_USED || pg->proc != p)
+      continue;
+    accessed = (*pg->pte & PTE_A) != 0;
+    if(aging)
+      policy_age(pg, accessed);
+    if(accessed){
+      if(!aging)
+        pg->ref = 1;
+      *pg->pte &= ~PTE_A;
+    }
+  }
+}
+
+void
+pexit(struct proc *p)
+{
+  struct page *pg;
+  struct vpage **h, *v;
+  int i;
+
+  for(pg = frames; pg < &frames[nframe]; pg++){
+    if(pg->state == P_USED && pg->proc == p){
+      clock_remove(&clock, pg);
+      pg->state = P_UNUSED;
+    }
+  }
+  ghost_forget(p);
+  for(i = 0; i < NHASH; i++){
+    for(h = &vhash[i]; (v = *h) != 0; ){
+      if(v->pid == p->pid){
+        *h = v->next;
+        free(v);
+      } else {
+        h = &v->next;
+      }
+    }
+  }
+  procs[p->pid] = 0;
+  free(p);
+}
+
+void
+reset(int n)
+{
+  struct vpage *v;
+  int i;
+
+  for(i = 0; i < NHASH; i++){
+    while((v = vhash[i]) != 0){
+      vhash[i] = v->next;
+      free(v);
+    }
+  }
+  for(i = 0; i <= maxpid; i++){
+    free(procs[i]);
+    procs[i] = 0;
+  }
+  free(frames);
+  free(ptes);
+  nframe = n;
+  frames = calloc(n, sizeof(struct page));
+  ptes = calloc(n, sizeof(pte_t));
+  if(frames == 0 || ptes == 0){
+    perror("pgsim");
+    exit(1);
+  }
+  for(i = 0; i < n; i++)
+    frames[i].state = P_UNUSED;
+  memset(&clock, 0, sizeof(clock));
+  memset(&stat, 0, sizeof(stat));
+}
+
+void
+run(int policy, int n, int readus, int writeus)
+{
+  struct trace *t;
+  struct proc *p;
+  int i;
+
+  reset(n);
+  defpolicy = policy;
+  for(t = trace; t < &trace[ntrace]; t++){
+    ticks = t->tick;
+    p = getproc(t->pid, policy);
+    switch(t->type){
+    case TR_FAULT:
+    case TR_ACCESS:
+      reference(p, t->va, t->write);
+      break;
+    case TR_AGE:
+      age(p);
+      break;
+    case TR_EXIT:
+      pexit(p);
+      break;
+    }
+  }
+  for(i = 0; i <= maxpid; i++){
+    if(procs[i])
+      ghost_forget(procs[i]);
+  }
+  printf("%-10s %6d %9ld %9ld %9ld %11.1f\n", names[policy], n,
+         stat.faults, stat.reads, stat.writes,
+         (stat.reads * readus + stat.writes * writeus) / 1000.0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int budgets[32], nbudget = 0, policy = -1, readus = 100, writeus = 100;
+  int i, j;
+  char *s;
+  FILE *f = stdin;
+
+  for(i = 1; i < argc && argv[i][0] == '-'; i++){
+    if(i + 1 == argc)
+      usage();
+    if(strcmp(argv[i], "-p") == 0){
+      for(policy = 0; policy < NPOLICY && strcmp(argv[i+1], names[policy]); policy++)
+        ;
+      if(policy == NPOLICY){
+        fprintf(stderr, "pgsim: unknown policy %s\n", argv[i+1]);
+        exit(1);
+      }
+    } else if(strcmp(argv[i], "-f") == 0){
+      for(s = argv[i+1]; *s && nbudget < 32; ){
+        if((budgets[nbudget++] = strtol(s, &s, 10)) <= 0)
+          usage();
+        if(*s == ',')
+          s++;
+      }
+    } else if(strcmp(argv[i], "-r") == 0){
+      readus = atoi(argv[i+1]);
+    } else if(strcmp(argv[i], "-w") == 0){
+      writeus = atoi(argv[i+1]);
+    } else {
+      usage();
+    }
+    i++;
+  }
+  if(i < argc && (f = fopen(argv[i], "r")) == 0){
+    perror(argv[i]);
+    exit(1);
+  }
+  if(nbudget == 0){
+    budgets[nbudget++] = 8;
+    budgets[nbudget++] = 16;
+    budgets[nbudget++] = 32;
+    budgets[nbudget++] = 64;
+  }
+
+  readtrace(f);
+  if((procs = calloc(maxpid + 1, sizeof(struct proc*))) == 0){
+    perror("pgsim");
+    exit(1);
+  }
+  printf("%d records\n", ntrace);
+  printf("%-10s %6s %9s %9s %9s %11s\n", "policy", "frames", "faults", "reads", "writes", "stall(ms)");
+  for(i = 0; i < NPOLICY; i++){
+    if(policy >= 0 && i != policy)
+      continue;
+    for(j = 0; j < nbudget; j++)
+      run(i, budgets[j], readus, writeus);
+  }
+  exit(0);
+}
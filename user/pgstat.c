@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/policy.h"
+#include "kernel/pgstat.h"
+#include "user/user.h"
+
+// print paging statistics:
+//   pgstat           of the whole system
+//   pgstat pid       of process pid
+
+char *names[NPOLICY] = {
+[POLICY_NFUA]      "nfua",
+[POLICY_LAPA]      "lapa",
+[POLICY_SCFIFO]    "scfifo",
+[POLICY_WSCLOCK]   "wsclock",
+[POLICY_CLOCKPRO]  "clockpro",
+[POLICY_ARC]       "arc",
+};
+
+void
+histogram(char *what, uint64 *lat)
+{
+  int i, last;
+
+  for(last = NLATBUCKET-1; last >= 0 && lat[last] == 0; last--)
+    ;
+  if(last < 0)
+    return;
+  printf("%s latency:\n", what);
+  for(i = 0; i <= last; i++)
+    printf("  < %l us\t%l\n", (((uint64)2 << i) * 1000000 + PGSTAT_HZ - 1) / PGSTAT_HZ, lat[i]);
+}
+
+void
+print(struct pgstat *st, int pid)
+{
+  int i;
+
+  printf("faults: %l minor, %l major\n", st->minflt, st->majflt);
+  printf("swapped in: %l pages, %l KB read\n", st->swapins, st->inbytes / 1024);
+  printf("swapped out: %l pages, %l KB written\n", st->swapouts, st->outbytes / 1024);
+  printf("evicted by:");
+  for(i = 0; i < NPOLICY; i++){
+    if(st->evicted[i])
+      printf(" %s %l", names[i], st->evicted[i]);
+  }
+  printf("\n");
+  if(pid)
+    printf("resident: %d pages, swapped: %d pages\n", st->resident, st->swapped);
+  printf("locked: %d pages, %l mlock() calls refused\n", st->locked, st->lockfails);
+  printf("free: %d pages\n", st->nfree);
+  histogram("swap read", st->rlat);
+  histogram("swap write", st->wlat);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct pgstat st;
+  int pid;
+
+  if(argc < 2){
+    getPagingStats(0, &st);
+    print(&st, 0);
+    exit(0);
+  }
+
+  pid = atoi(argv[1]);
+  if(pid <= 0 || getPagingStats(pid, &st) < 0){
+    fprintf(2, "pgstat: no process %s\n", argv[1]);
+    exit(1);
+  }
+  print(&st, pid);
+  exit(0);
+}
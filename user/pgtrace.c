@@ -0,0 +1,114 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/trace.h"
+#include "user/user.h"
+
+// run a command with page reference tracing on and print the trace
+// for pgsim on the host:
+//   pgtrace cmd args...
+// every record is a line "@ tick pid type va write" with type one of
+// F (page fault), A (found accessed), G (end of a trace pass) and
+// X (exit). lines go out in one write each, so the command's own
+// output can't split them.
+
+#define NREC 64
+
+struct trace rec[NREC];
+
+char types[] = {
+[TR_FAULT]   'F',
+[TR_ACCESS]  'A',
+[TR_EXIT]    'X',
+[TR_AGE]     'G',
+};
+
+char*
+putnum(char *s, uint64 x, int base)
+{
+  char buf[20];
+  int i = 0;
+
+  do {
+    buf[i++] = "0123456789abcdef"[x % base];
+    x /= base;
+  } while(x != 0);
+  while(--i >= 0)
+    *s++ = buf[i];
+  return s;
+}
+
+void
+putrec(struct trace *t)
+{
+  char line[64], *s = line;
+
+  if(t->type <= 0 || t->type >= sizeof(types))
+    return;
+  *s++ = '\n';
+  *s++ = '@';
+  *s++ = ' ';
+  s = putnum(s, t->tick, 10);
+  *s++ = ' ';
+  s = putnum(s, t->pid, 10);
+  *s++ = ' ';
+  *s++ = types[t->type];
+  *s++ = ' ';
+  s = putnum(s, t->va, 16);
+  *s++ = ' ';
+  s = putnum(s, t->write, 10);
+  *s++ = '\n';
+  write(1, line, s - line);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int pid, self, n, i, lost, done;
+
+  if(argc < 2){
+    fprintf(2, "usage: pgtrace cmd args...\n");
+    exit(1);
+  }
+
+  self = getpid();
+  setTrace(1);
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "pgtrace: fork failed\n");
+    setTrace(0);
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], &argv[1]);
+    fprintf(2, "pgtrace: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+
+  for(done = 0; !done; ){
+    if((n = readTrace(rec, NREC)) < 0)
+      break;
+    if(n == 0){
+      sleep(1);
+      continue;
+    }
+    for(i = 0; i < n; i++){
+      if(rec[i].pid == self)
+        continue;
+      putrec(&rec[i]);
+      if(rec[i].type == TR_EXIT && rec[i].pid == pid)
+        done = 1;
+    }
+  }
+
+  lost = setTrace(0);
+  while((n = readTrace(rec, NREC)) > 0){
+    for(i = 0; i < n; i++){
+      if(rec[i].pid != self)
+        putrec(&rec[i]);
+    }
+  }
+  wait(0);
+  if(lost > 0)
+    fprintf(2, "pgtrace: %d records lost\n", lost);
+  exit(0);
+}
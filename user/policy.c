@@ -0,0 +1,73 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/policy.h"
+#include "user/user.h"
+
+// set the page replacement policy:
+//   policy                   print the system-wide policy
+//   policy name              set it for every process
+//   policy name -p pid       set it for process pid
+//   policy name cmd args...  run cmd with it
+
+char *names[NPOLICY] = {
+[POLICY_NFUA]      "nfua",
+[POLICY_LAPA]      "lapa",
+[POLICY_SCFIFO]    "scfifo",
+[POLICY_WSCLOCK]   "wsclock",
+[POLICY_CLOCKPRO]  "clockpro",
+[POLICY_ARC]       "arc",
+};
+
+void
+usage(void)
+{
+  fprintf(2, "usage: policy [name [-p pid | cmd args...]]\n");
+  exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pol;
+
+  if(argc < 2){
+    pol = setPolicy(0, -1);
+    printf("%s\n", pol >= 0 && pol < NPOLICY ? names[pol] : "?");
+    exit(0);
+  }
+
+  for(pol = 0; pol < NPOLICY; pol++){
+    if(strcmp(argv[1], names[pol]) == 0)
+      break;
+  }
+  if(pol == NPOLICY){
+    fprintf(2, "policy: unknown policy %s, one of:", argv[1]);
+    for(i = 0; i < NPOLICY; i++)
+      fprintf(2, " %s", names[i]);
+    fprintf(2, "\n");
+    exit(1);
+  }
+
+  if(argc == 2){
+    setPolicy(0, pol);
+    exit(0);
+  }
+  if(strcmp(argv[2], "-p") == 0){
+    if(argc != 4)
+      usage();
+    if(setPolicy(atoi(argv[3]), pol) < 0){
+      fprintf(2, "policy: can't set the policy of process %s\n", argv[3]);
+      exit(1);
+    }
+    exit(0);
+  }
+
+  // under global reclaim there is only the system-wide policy.
+  if(setPolicy(getpid(), pol) < 0){
+    fprintf(2, "policy: no per-process policies in this kernel\n");
+    exit(1);
+  }
+  exec(argv[2], &argv[2]);
+  fprintf(2, "policy: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -2,6 +2,7 @@
 //#include "kernel/stat.h"
 //#include "user.h"
 //#include "kernel/fs.h"
+#include "kernel/fcntl.h"
 //
 //
 //#define PGSIZE 4096
@@ -78,6 +79,8 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/fs.h"
+#include "kernel/policy.h"
+#include "kernel/pgstat.h"
 
 #define PGSIZE 4096
 #define ARR_SIZE 55000
@@ -116,6 +119,493 @@ void nirdanForkTest(){
 }
 
 
+/*
+	Test used to check copy-on-write fork: the child shares the parent's
+	pages, so fork takes far fewer pages than the parent maps, and writes
+	on either side stay private.
+*/
+void cowForkTest(){
+    char * arr = sbrk(10*PGSIZE);
+    int i, before;
+    for (i = 0; i < 10; i++)
+        arr[i*PGSIZE] = 'P';
+
+    before = getFreePagesAmount();
+    if (fork() == 0){ //is son
+        if (before - getFreePagesAmount() >= 10)
+            printf("cowForkTest Failed: fork copied the pages\n");
+        arr[0] = 'C';
+        exit(arr[PGSIZE] == 'P' ? 0 : 1);
+    } else { //is parent
+        int status;
+        wait(&status);
+        if (status == 0 && arr[0] == 'P')
+            printf("cowForkTest Passed\n");
+        else
+            printf("cowForkTest Failed\n");
+        sbrk(-10*PGSIZE);
+    }
+}
+
+
+/*
+	Test used to check the swap cache: pages cycled through the resident
+	limit come back intact whether they were written in between or not,
+	also when the kernel wrote them (read() into a swapped-in page).
+*/
+void swapCacheTest(){
+    int n = 12, i, round, fds[2];
+    char * arr = sbrk(n*PGSIZE);
+    for (i = 0; i < n; i++)
+        arr[i*PGSIZE] = 'a' + i;
+
+    for (round = 0; round < 3; round++) { //read only: evicting these again writes nothing
+        for (i = 0; i < n; i++) {
+            if (arr[i*PGSIZE] != 'a' + i) {
+                printf("swapCacheTest Failed: page %d lost in round %d\n", i, round);
+                sbrk(-n*PGSIZE);
+                return;
+            }
+        }
+    }
+
+    pipe(fds);
+    for (i = 0; i < n; i++) {
+        if (i % 2)
+            arr[i*PGSIZE] = 'A' + i;
+        else {
+            char c = 'A' + i;
+            write(fds[1], &c, 1);
+            read(fds[0], &arr[i*PGSIZE], 1);
+        }
+    }
+    close(fds[0]);
+    close(fds[1]);
+
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < n; i++) {
+            if (arr[i*PGSIZE] != 'A' + i) {
+                printf("swapCacheTest Failed: write to page %d lost\n", i);
+                sbrk(-n*PGSIZE);
+                return;
+            }
+        }
+    }
+    printf("swapCacheTest Passed\n");
+    sbrk(-n*PGSIZE);
+}
+
+
+/*
+	Test used to check run-time policy selection: each policy pages a
+	working set larger than the resident limit without losing data, and a
+	child inherits its parent's policy. Under GLOBAL_RECLAIM only the
+	system-wide policy can be set.
+*/
+void policyTest(){
+    int n = 12, i, pol, status, old = setPolicy(getpid(), -1);
+    int global = setPolicy(getpid(), old) < 0;
+    char * arr = sbrk(n*PGSIZE);
+    for (pol = 0; pol < NPOLICY; pol++) {
+        if (setPolicy(global ? 0 : getpid(), pol) < 0) {
+            printf("policyTest Failed: setPolicy %d\n", pol);
+            break;
+        }
+        for (i = 0; i < n; i++)
+            arr[i*PGSIZE] = pol*n + i;
+        for (i = 0; i < n; i++) {
+            if (arr[i*PGSIZE] != pol*n + i) {
+                printf("policyTest Failed: page %d lost with policy %d\n", i, pol);
+                break;
+            }
+        }
+        if (fork() == 0)
+            exit(setPolicy(getpid(), -1) == pol ? 0 : 1);
+        wait(&status);
+        if (status != 0)
+            printf("policyTest Failed: policy %d not inherited\n", pol);
+    }
+    setPolicy(global ? 0 : getpid(), old);
+    sbrk(-n*PGSIZE);
+    printf("policyTest done\n");
+}
+
+
+/*
+	Test used to check the paging statistics: every first touch of a
+	page sbrk() reserved is a minor fault, and no more pages come back
+	from swap space than went out.
+*/
+void statsTest(){
+    struct pgstat before, after;
+    int n = 12, i, round;
+    char * arr = sbrk(n*PGSIZE);
+    getPagingStats(getpid(), &before);
+    for (round = 0; round < 2; round++)
+        for (i = 0; i < n; i++)
+            arr[i*PGSIZE] = i;
+    if (getPagingStats(getpid(), &after) < 0)
+        printf("statsTest Failed: getPagingStats\n");
+    else if (after.minflt < before.minflt + n)
+        printf("statsTest Failed: %d minor faults for %d new pages\n", (int)(after.minflt - before.minflt), n);
+    else if (after.swapins > after.swapouts)
+        printf("statsTest Failed: %d pages in, %d out\n", (int)after.swapins, (int)after.swapouts);
+    else
+        printf("statsTest Passed\n");
+    sbrk(-n*PGSIZE);
+}
+
+
+/*
+	Test used to check madvise(): pages thrown away with MADV_DONTNEED
+	come back zero, and the other advice leaves the data alone.
+*/
+void madviseTest(){
+    int n = 12, i, adv;
+    char * base = sbrk((n+1)*PGSIZE);
+    char * arr = (char*)(((uint64)base + PGSIZE-1) & ~(PGSIZE-1)); //madvise() takes whole pages
+    for (adv = MADV_RANDOM; adv <= MADV_WILLNEED; adv++) {
+        for (i = 0; i < n; i++)
+            arr[i*PGSIZE] = adv*n + i;
+        if (madvise(arr, n*PGSIZE, adv) < 0) {
+            printf("madviseTest Failed: advice %d\n", adv);
+            sbrk(-(n+1)*PGSIZE);
+            return;
+        }
+        for (i = 0; i < n; i++) {
+            if (arr[i*PGSIZE] != adv*n + i) {
+                printf("madviseTest Failed: page %d lost with advice %d\n", i, adv);
+                sbrk(-(n+1)*PGSIZE);
+                return;
+            }
+        }
+    }
+    madvise(arr, n*PGSIZE, MADV_NORMAL);
+    madvise(arr, n*PGSIZE, MADV_DONTNEED);
+    for (i = 0; i < n; i++) {
+        if (arr[i*PGSIZE] != 0) {
+            printf("madviseTest Failed: page %d kept after MADV_DONTNEED\n", i);
+            sbrk(-(n+1)*PGSIZE);
+            return;
+        }
+    }
+    if (madvise(arr + 1, PGSIZE, MADV_DONTNEED) == 0)
+        printf("madviseTest Failed: unaligned range taken\n");
+    else
+        printf("madviseTest Passed\n");
+    sbrk(-(n+1)*PGSIZE);
+}
+
+
+/*
+	Test used to check mlock(): locked pages stay in while others are
+	paged out around them, and the pinned-page limit holds.
+*/
+void mlockTest(){
+    struct pgstat before, after;
+    int n = 10, i, round; //2 locked pages and 8 that page around them
+    char * base = sbrk((n+2)*PGSIZE);
+    char * arr = (char*)(((uint64)base + PGSIZE-1) & ~(PGSIZE-1));
+    if (mlock(arr, (n+1)*PGSIZE) == 0) {
+        printf("mlockTest Failed: %d pages locked, over the limit\n", n+1);
+        munlock(arr, (n+1)*PGSIZE);
+    } else if (mlock(arr, 2*PGSIZE) < 0) {
+        printf("mlockTest Failed: mlock\n");
+    } else {
+        arr[0] = 'L';
+        arr[PGSIZE] = 'M';
+        for (round = 0; round < 3; round++)
+            for (i = 2; i < n; i++)
+                arr[i*PGSIZE] = i;
+        getPagingStats(getpid(), &before);
+        if (arr[0] != 'L' || arr[PGSIZE] != 'M')
+            printf("mlockTest Failed: locked page lost\n");
+        getPagingStats(getpid(), &after);
+        if (after.majflt != before.majflt)
+            printf("mlockTest Failed: locked page was paged out\n");
+        else if (after.locked != 2)
+            printf("mlockTest Failed: %d pages locked, not 2\n", after.locked);
+        else if (madvise(arr, 2*PGSIZE, MADV_DONTNEED) == 0 || arr[0] != 'L')
+            printf("mlockTest Failed: MADV_DONTNEED dropped a locked page\n");
+        else if (munlock(arr, 2*PGSIZE) < 0 || getPagingStats(getpid(), &after) < 0 || after.locked != 0)
+            printf("mlockTest Failed: munlock\n");
+        else
+            printf("mlockTest Passed\n");
+    }
+    sbrk(-(n+2)*PGSIZE);
+}
+
+
+/*
+	Test used to check megapages: a 2MB block of heap keeps its data
+	through fork and through an sbrk() that cuts it in two, whether the
+	kernel mapped it with one megapage or with pages.
+*/
+#define MEGASIZE (1 << 21)
+void megapageTest(){
+    char * base = sbrk(3*MEGASIZE);
+    char * blk = (char*)(((uint64)base + MEGASIZE-1) & ~(MEGASIZE-1));
+    int status, cut;
+    blk[0] = 'a';
+    blk[MEGASIZE/2] = 'm';
+    blk[MEGASIZE-1] = 'z';
+    if (fork() == 0) {
+        blk[0] = 'c';
+        exit(blk[MEGASIZE/2] == 'm' && blk[MEGASIZE-1] == 'z' ? 0 : 1);
+    }
+    wait(&status);
+    cut = base + 3*MEGASIZE - (blk + MEGASIZE/2 + PGSIZE);
+    sbrk(-cut);
+    if (status != 0)
+        printf("megapageTest Failed: child lost data\n");
+    else if (blk[0] != 'a' || blk[MEGASIZE/2] != 'm')
+        printf("megapageTest Failed: data lost\n");
+    else
+        printf("megapageTest Passed\n");
+    sbrk(-(3*MEGASIZE - cut));
+}
+
+
+/*
+	Test used to check that no stale TLB entry outlives a change to the
+	page table now that traps keep them: a write right after fork must
+	not reach the child's copy, and a page given back with sbrk() and
+	taken again must come back zeroed. sleep() lets the processes move
+	between harts in between.
+*/
+void tlbTest(){
+    char * arr = sbrk(PGSIZE);
+    int round, status;
+    for (round = 0; round < 10; round++) {
+        arr[0] = 'P';
+        if (fork() == 0) {
+            sleep(1);
+            exit(arr[0] == 'P' ? 0 : 1);
+        }
+        arr[0] = 'Q';
+        wait(&status);
+        if (status != 0) {
+            printf("tlbTest Failed: parent wrote the child's page\n");
+            sbrk(-PGSIZE);
+            return;
+        }
+        sbrk(-PGSIZE);
+        sleep(1);
+        arr = sbrk(PGSIZE);
+        if (arr[0] != 0) {
+            printf("tlbTest Failed: freed page still mapped\n");
+            sbrk(-PGSIZE);
+            return;
+        }
+    }
+    printf("tlbTest Passed\n");
+    sbrk(-PGSIZE);
+}
+
+
+/*
+	Test used to check that a process can outgrow the old fixed swap
+	records: three times the resident limit is written and read back,
+	most of it from swap space.
+*/
+void bigHeapTest(){
+    int n = 48, i;
+    char * arr = sbrk(n*PGSIZE);
+    for (i = 0; i < n; i++)
+        arr[i*PGSIZE] = 'A' + i % 26;
+    for (i = 0; i < n; i++) {
+        if (arr[i*PGSIZE] != 'A' + i % 26) {
+            printf("bigHeapTest Failed: page %d lost\n", i);
+            sbrk(-n*PGSIZE);
+            return;
+        }
+    }
+    printf("bigHeapTest Passed\n");
+    sbrk(-n*PGSIZE);
+}
+
+
+/*
+	Test used to check a heap far past what a swap file can hold
+	(MAXFILE blocks) on top of the resident limit: the pages that don't
+	fit in memory go to the swap disk and all of them come back intact.
+*/
+void swapCapacityTest(){
+    int n = 1024, i;
+    struct pgstat st;
+    char * arr = sbrk(n*PGSIZE);
+    for (i = 0; i < n; i++)
+        arr[i*PGSIZE] = 'A' + i % 26;
+    getPagingStats(getpid(), &st);
+    for (i = 0; i < n; i++) {
+        if (arr[i*PGSIZE] != 'A' + i % 26) {
+            printf("swapCapacityTest Failed: page %d lost\n", i);
+            sbrk(-n*PGSIZE);
+            return;
+        }
+    }
+#ifndef GLOBAL_RECLAIM
+    if (st.swapped <= MAXFILE*BSIZE/PGSIZE) {
+        printf("swapCapacityTest Failed: swap space ran out at %d pages\n", st.swapped);
+        sbrk(-n*PGSIZE);
+        return;
+    }
+#endif
+    printf("swapCapacityTest Passed\n");
+    sbrk(-n*PGSIZE);
+}
+
+/*
+	Test used to check the deferred exit cleanup: children that swap
+	exit one after another, and their memory comes back once kreapd
+	has caught up.
+*/
+void reapTest(){
+    int n = 24, i, j, before;
+    before = getFreePagesAmount();
+    for (i = 0; i < 8; i++) {
+        if (fork() == 0) { //is son
+            char * arr = sbrk(n*PGSIZE);
+            for (j = 0; j < n; j++)
+                arr[j*PGSIZE] = 'R';
+            exit(0);
+        }
+        wait(0);
+    }
+    sleep(10);
+    if (before - getFreePagesAmount() > 4)
+        printf("reapTest Failed: %d pages not freed\n", before - getFreePagesAmount());
+    else
+        printf("reapTest Passed\n");
+}
+
+
+/*
+	Test used to check the per-hart page caches: children on several
+	harts allocate and free at once, and no page is lost or handed
+	out twice on the way between the caches.
+*/
+void kallocTest(){
+    int n = 32, i, j, k, status, failed = 0, before;
+    before = getFreePagesAmount();
+    for (i = 0; i < 4; i++) {
+        if (fork() == 0) { //is son
+            for (k = 0; k < 10; k++) {
+                char * arr = sbrk(n*PGSIZE);
+                for (j = 0; j < n; j++)
+                    arr[j*PGSIZE] = 'a' + i;
+                for (j = 0; j < n; j++)
+                    if (arr[j*PGSIZE] != 'a' + i)
+                        exit(1);
+                sbrk(-n*PGSIZE);
+            }
+            exit(0);
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        wait(&status);
+        if (status != 0)
+            failed = 1;
+    }
+    sleep(10);
+    if (failed)
+        printf("kallocTest Failed: a page was shared\n");
+    else if (before - getFreePagesAmount() > 4)
+        printf("kallocTest Failed: %d pages lost\n", before - getFreePagesAmount());
+    else
+        printf("kallocTest Passed\n");
+}
+
+
+/*
+	Test used to check system calls on paged-out buffers: pages written
+	out to swap space are read from by write() and written to by read(),
+	through a file and through a pipe, whose copies run under a spinlock.
+*/
+void copyPagedOutTest(){
+    int n = 40, i, fd, got, r, fds[2];
+    char * arr = sbrk(n*PGSIZE);
+    for (i = 0; i < n; i++)
+        arr[i*PGSIZE] = 'a' + i % 26; //pages 0..3 go out first
+
+    fd = open("copytest", O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, arr, 4*PGSIZE) != 4*PGSIZE) {
+        printf("copyPagedOutTest Failed: write() from paged-out pages\n");
+        goto out;
+    }
+    close(fd);
+    fd = open("copytest", O_RDONLY);
+    if (read(fd, arr + 20*PGSIZE, 4*PGSIZE) != 4*PGSIZE) {
+        printf("copyPagedOutTest Failed: read() into paged-out pages\n");
+        goto out;
+    }
+    for (i = 0; i < 4; i++) {
+        if (arr[(20+i)*PGSIZE] != 'a' + i % 26) {
+            printf("copyPagedOutTest Failed: file copy of page %d\n", i);
+            goto out;
+        }
+    }
+
+    for (i = 4; i < n; i++) //page 0..3 out again
+        arr[i*PGSIZE] = 'a' + i % 26;
+    pipe(fds);
+    if (fork() == 0) { //is son
+        close(fds[0]);
+        exit(write(fds[1], arr, 4*PGSIZE) == 4*PGSIZE ? 0 : 1);
+    }
+    close(fds[1]);
+    for (got = 0; got < 4*PGSIZE; got += r) {
+        if ((r = read(fds[0], arr + 30*PGSIZE + got, 4*PGSIZE - got)) <= 0)
+            break;
+    }
+    close(fds[0]);
+    wait(&r);
+    if (got != 4*PGSIZE || r != 0) {
+        printf("copyPagedOutTest Failed: pipe copy stopped at %d bytes\n", got);
+        goto out;
+    }
+    for (i = 0; i < 4; i++) {
+        if (arr[(30+i)*PGSIZE] != 'a' + i % 26) {
+            printf("copyPagedOutTest Failed: pipe copy of page %d\n", i);
+            goto out;
+        }
+    }
+    printf("copyPagedOutTest Passed\n");
+out:
+    close(fd);
+    unlink("copytest");
+    sbrk(-n*PGSIZE);
+}
+
+void copyLazyTest(){
+    int n = 24, i, fd;
+    char * arr = sbrk(2*n*PGSIZE); //none of it touched yet
+
+    //the copies touch every page first, more than a process keeps resident
+    fd = open("lazytest", O_CREATE | O_RDWR);
+    if (fd < 0 || write(fd, arr, n*PGSIZE) != n*PGSIZE) {
+        printf("copyLazyTest Failed: write() from untouched pages\n");
+        goto out;
+    }
+    close(fd);
+    fd = open("lazytest", O_RDONLY);
+    if (read(fd, arr + n*PGSIZE, n*PGSIZE) != n*PGSIZE) {
+        printf("copyLazyTest Failed: read() into untouched pages\n");
+        goto out;
+    }
+    for (i = 0; i < 2*n; i++) {
+        if (arr[i*PGSIZE] != 0) {
+            printf("copyLazyTest Failed: page %d isn't zero\n", i);
+            goto out;
+        }
+    }
+    printf("copyLazyTest Passed\n");
+out:
+    close(fd);
+    unlink("lazytest");
+    sbrk(-2*n*PGSIZE);
+}
+
 static unsigned long int next = 1;
 int getRandNum() {
     next = next * 1103515245 + 12341;
@@ -157,5 +647,19 @@ void globalTest(){
 int main(int argc, char *argv[]){
     globalTest();			//for testing each policy efficiency
 //    forkTest();			//for testing swapping machanism in fork.
+    cowForkTest();			//for testing copy-on-write fork
+    swapCacheTest();			//for testing the swap cache
+    policyTest();			//for testing run-time policy selection
+    statsTest();			//for testing the paging statistics
+    madviseTest();			//for testing madvise() hints
+    mlockTest();			//for testing mlock()
+    megapageTest();			//for testing megapages
+    tlbTest();			//for testing TLB invalidation with ASIDs
+    bigHeapTest();			//for testing heaps past the old 32-page limit
+    swapCapacityTest();		//for testing heaps past what a swap file holds
+    reapTest();			//for testing deferred cleanup at exit
+    kallocTest();			//for testing the per-hart page caches
+    copyPagedOutTest();		//for testing system calls on paged-out buffers
+    copyLazyTest();			//for testing system calls on untouched buffers
     exit(0);
 }
\ No newline at end of file
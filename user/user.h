@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct trace;
+struct pgstat;
 
 // system calls
 int fork(void);
@@ -25,6 +27,13 @@ int sleep(int);
 int uptime(void);
 int getFreePagesAmount(void);
 int getPageFaultAmount(void);
+int setPolicy(int, int);
+int setTrace(int);
+int readTrace(struct trace*, int);
+int getPagingStats(int, struct pgstat*);
+int madvise(void*, int, int);
+int mlock(void*, int);
+int munlock(void*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
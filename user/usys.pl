@@ -38,3 +38,10 @@ entry("sleep");
 entry("uptime");
 entry("getFreePagesAmount");
 entry("getPageFaultAmount");
+entry("setPolicy");
+entry("setTrace");
+entry("readTrace");
+entry("getPagingStats");
+entry("madvise");
+entry("mlock");
+entry("munlock");